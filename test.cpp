@@ -1,10 +1,41 @@
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 #include <GL/glut.h>
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h>
+#endif
 #include <GL/glu.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
 #include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <chrono>
+#include <atomic>
+#include <new>
+#ifdef UFO_ALSA
+#include <alsa/asoundlib.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UFO_SSE2
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -17,667 +48,4150 @@
 #define GL_CLAMP_TO_EDGE 0x812F
 #endif
 
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
 const int SCREEN_WIDTH = 800, SCREEN_HEIGHT = 600;
 const float PLAYER_SPEED = 8.0f, LASER_SPEED = 15.0f, SHOOT_COOLDOWN = 400.0f;
 const float GRAVITY = 0.5f, BALL_BOUNCE_FACTOR = 1.0f;
-const float INVISIBILITY_DURATION = 10000.0f, METEOR_DROP_INTERVAL = 10000.0f;
-const float METEOR_FALL_SPEED = 3.0f, METEOR_EXPLOSION_RADIUS = 100.0f;
+constexpr float INVISIBILITY_DURATION = 10000.0f, METEOR_DROP_INTERVAL = 10000.0f;
+const float METEOR_FALL_SPEED = 3.0f, METEOR_EXPLOSION_RADIUS = 100.0f, METEOR_HIT_RADIUS = 20.0f;
 const int MAX_INVISIBILITY_USES = 3, INVISIBILITY_REWARD_INTERVAL = 1000;
 const int BALL_SPAWN_SCORE_INTERVAL = 500;
 const float BG_COLOR[3] = { 0.05f, 0.15f, 0.3f }, GROUND_COLOR[3] = { 0.3f, 0.5f, 0.2f };
 const float UI_PANEL_COLOR[4] = { 0.1f, 0.1f, 0.15f, 0.7f }, UI_HIGHLIGHT_COLOR[3] = { 0.4f, 0.8f, 1.0f };
 const float UI_TEXT_COLOR[3] = { 1.0f, 1.0f, 1.0f };
 const int BUBBLE_EFFECT_BOUNCE = 0, BUBBLE_EFFECT_POP = 1, BUBBLE_EFFECT_SPLIT = 2;
+const int BALL_EVENT_FLOOR = 0, BALL_EVENT_LEFT_WALL = 1, BALL_EVENT_RIGHT_WALL = 2, BALL_EVENT_ENTER_BAND = 3;
+const int SIM_TICK_MS = 16, MAX_SIM_STEP_TICKS = 64, MAX_BALL_SEGMENTS = 8;
+const float FLOOR_Y = SCREEN_HEIGHT - 10;
+const int MAX_PARTICLES = 131072, SPLIT_PARTICLES = 1500, POP_PARTICLES = 800, METEOR_PARTICLES = 4000;
+const float PARTICLE_GRAVITY = 0.15f, PARTICLE_DRAG = 0.98f;
+const int MAX_TRAIL_LENGTH = 24;
+const int MAX_SWARM_COUNT = 100000;
+const int MAX_PROJECTILES = 1024, NO_TARGET = -1, PROJECTILE_JOB_GRAIN = 64;
+const int WEAPON_LASER = 0, WEAPON_SPREAD = 1, WEAPON_RAPID = 2, WEAPON_PIERCE = 3, WEAPON_COUNT = 4;
+const float BOLT_RADIUS = 3.0f;
+const int GRID_CELL_SIZE = 64, GRID_COLUMNS = SCREEN_WIDTH / GRID_CELL_SIZE + 1, GRID_ROWS = SCREEN_HEIGHT / GRID_CELL_SIZE + 1;
+// Cells a ball's swept bounds cover in one tick: up to 120 px wide plus its motion, so 4 x 4.
+const int GRID_BALL_CELLS = 16;
+const int INPUT_QUEUE_SIZE = 256, SNAPSHOT_FRESH = 4, IDLE_FRAME_MS = 100;
+const int MAX_JOB_THREADS = 64, MAX_QUEUED_JOBS = 1024, BALL_JOB_GRAIN = 512;
+const int BALL_POOL_SIZE = 1024, METEOR_POOL_SIZE = 256, EFFECT_POOL_SIZE = 4096, BURST_POOL_SIZE = 256;
+const size_t FRAME_ARENA_SIZE = 1 << 20;
+const int ALLOC_CHECK_WARMUP_TICKS = 1000;
+const float MIN_RENDER_SCALE = 0.5f, RENDER_SCALE_STEP = 0.05f;
+const int RENDER_SCALE_COOLDOWN_MS = 500;
+const int GPU_TIMER_QUERIES = 3;
+const int QUALITY_TIER_COUNT = 4;
+const int RENDER_FRAME = 0, RENDER_PLAYER = 1, RENDER_TRAILS = 2, RENDER_EFFECTS = 3, RENDER_BALLS = 4, RENDER_METEORS = 5;
+const int RENDER_PARTICLES = 6, RENDER_PROJECTILES = 7, RENDER_HUD = 8, RENDER_SUBSYSTEM_COUNT = 9;
+const char* const RENDER_SUBSYSTEM_NAMES[RENDER_SUBSYSTEM_COUNT] = {
+    "frame", "player", "trails", "effects", "balls", "meteors", "particles", "projectiles", "hud"
+};
+const int SDF_BALL = 0, SDF_DISC = 1, SDF_GLOW = 2, SDF_RING = 3;
+const int TELEMETRY_RING_SIZE = 1 << 16, TELEMETRY_FLUSH_MS = 50;
+const int TELEMETRY_BALL_SPAWN = 0, TELEMETRY_BALL_SPLIT = 1, TELEMETRY_SHOT_FIRED = 2, TELEMETRY_SHOT_HIT = 3;
+const int TELEMETRY_METEOR_DROP = 4, TELEMETRY_METEOR_EXPLODE = 5, TELEMETRY_INVISIBILITY = 6, TELEMETRY_DEATH = 7;
+const int DEATH_BALL = 0, DEATH_METEOR = 1;
+const int AUDIO_RATE = 48000, AUDIO_BLOCK_FRAMES = 256, AUDIO_QUEUE_SIZE = 256, MAX_VOICES = 64, ALSA_LATENCY_US = 20000;
+const int AUDIO_OFF = 0, AUDIO_NULL = 1, AUDIO_WAV = 2, AUDIO_ALSA = 3;
+const int SOUND_LASER = 0, SOUND_POP = 1, SOUND_SPLIT = 2, SOUND_METEOR = 3, SOUND_INVISIBILITY = 4, SOUND_COUNT = 5;
+const float AUDIO_MASTER_GAIN = 0.5f;
+#ifdef UFO_ALSA
+const int DEFAULT_AUDIO = AUDIO_ALSA;
+#else
+const int DEFAULT_AUDIO = AUDIO_OFF;
+#endif
+const int AUTOPILOT_HORIZON = 48, AUTOPILOT_MAX_BALLS = 96, AUTOPILOT_PLANS = 5, AUTOPILOT_PANIC_TICKS = 6;
+const float AUTOPILOT_MARGIN = 12.0f;
+const unsigned REPLAY_MAGIC = 0x52464F55u, REPLAY_VERSION = 2, STATE_HASH_SEED = 2166136261u;
+const int REPLAY_EVENT_PHYSICS = 1, REPLAY_FIXED_POINT = 2, REPLAY_MODE_SHIFT = 8, REPLAY_END = -1, REPLAY_CHECKPOINT_STEPS = 60;
+const int FIXED_ONE = 1 << 16, FIXED_DEGREE = 1144;
+const int GAME_MODE_CLASSIC = 0, GAME_MODE_COUNT = 4;
+const int TIMER_WHEEL_BITS = 8, TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS, TIMER_WHEEL_LEVELS = 3, MAX_TIMERS = 1024;
+const int TIMER_SCORE = 0, TIMER_METEOR_DROP = 1, TIMER_INVISIBILITY = 2, TIMER_EXPIRY_SWEEP = 3;
+const int SCORE_INTERVAL_TICKS = (1000 + SIM_TICK_MS - 1) / SIM_TICK_MS;
+const int INVISIBILITY_TICKS = (static_cast<int>(INVISIBILITY_DURATION) + SIM_TICK_MS - 1) / SIM_TICK_MS;
+const int EFFECT_LIFETIME_MS = 500, METEOR_EXPLOSION_MS = 1000;
+const int ENTITY_CHUNK_BYTES = 16384, MAX_ARCHETYPES = 16;
+const int LEADERBOARD_SIZE = 10;
+const char* const LEADERBOARD_FILE = "highscore.txt";
 
 struct Vector2 { float x, y; };
-struct Ball { Vector2 position, velocity; float radius; int points; };
-struct Laser { Vector2 position; float startX; bool isActive; };
+// Q16.16 fixed point for the deterministic physics mode.
+typedef int Fixed;
+struct FixedVector { Fixed x, y; };
+// time, generation and hotSlot are only used by the event-driven physics mode; trail is a ring of
+// recent positions with trailHead pointing at the newest entry. In the fixed-point mode fixedPosition
+// and fixedVelocity are the real state and position and velocity mirror them for everything else.
+struct Ball {
+    Vector2 position, velocity; float radius; int points; double time; unsigned generation; int hotSlot;
+    Vector2 trail[MAX_TRAIL_LENGTH]; int trailHead, trailCount;
+    FixedVector fixedPosition, fixedVelocity;
+};
+// Beams are the classic laser: a vertical line from the player up to a tip rising from position at
+// startX. Bolts are short shots flying along velocity; pierce is how many more balls a bolt can pop.
+// The fixed-point mode moves fixedPosition by fixedVelocity and mirrors it into position.
+struct Projectile { Vector2 position, velocity; float startX; int weapon, pierce; bool isActive, isBeam; FixedVector fixedPosition, fixedVelocity; };
+struct GridRange { int x0, y0, x1, y1; };
+// Broadphase for projectile hits: each ball's swept bounds for the step, bucketed into screen cells.
+// Items are ball indices at build time; current maps them to today's index (-1 once popped) and
+// balls created during the pass are listed in added instead. meteorGrid buckets meteor rows the
+// same way and only uses ranges, cellStart and items.
+struct BallGrid {
+    std::vector<GridRange> ranges; std::vector<int> cellStart, items, current, origin, added;
+};
+// GL work submitted by one RENDER_* subsystem in a frame. A draw call is a glBegin batch, array
+// draw, bitmap character, clear or screen copy; state changes are enables, blend, line/point size,
+// program, client-array and texture-environment changes.
+struct RenderCounters { int drawCalls, vertices, textureBinds, stateChanges; };
+// Presentation-only detail level: trail positions drawn per bubble, bubble effects drawn per frame
+// (newest first), degrees per segment of fixed-function circles, and whether glows, pulses and
+// highlights are drawn.
+struct QualityTier { const char* name; int trailLength, maxEffects, circleStep; bool glow; };
+struct Weapon { const char* name; float cooldown; int shots; float spread, speed; int pierce; bool beam; float color[3]; };
 struct Player {
     Vector2 position; bool isMoving; float width, height; int lastShootTime;
     bool isInvisible; int invisibilityStartTime; int remainingInvisibilityUses;
-    float direction;
+    float direction; int weapon;
+};
+// Game modes are policy types the simulation step is compiled for, so a rule a mode switches off
+// costs nothing in its loops. GameMode is the runtime entry for each, used to pick the step.
+struct ClassicMode {
+    static constexpr bool meteors = true, lethal = true, invisibilityRewards = true;
+    static constexpr float meteorInterval = METEOR_DROP_INTERVAL;
+    static constexpr int invisibilityUses = MAX_INVISIBILITY_USES, spawnScoreInterval = BALL_SPAWN_SCORE_INTERVAL;
+};
+struct HardcoreMode : ClassicMode {
+    static constexpr bool invisibilityRewards = false;
+    static constexpr float meteorInterval = 4000.0f;
+    static constexpr int invisibilityUses = 0, spawnScoreInterval = BALL_SPAWN_SCORE_INTERVAL / 2;
+};
+struct NoMeteorMode : ClassicMode { static constexpr bool meteors = false; };
+struct ZenMode : ClassicMode { static constexpr bool lethal = false; };
+struct GameMode { const char* name; void (*update)(); bool meteors; int invisibilityUses, spawnScoreInterval; };
+// Entity components: plain data, stored as one array per component in each chunk. ID is the
+// component's bit in an archetype mask. A Lifetime with durationMs < 0 never expires.
+struct Position { static const int ID = 0; Vector2 value; };
+struct Lifetime { static const int ID = 1; int startTime, durationMs; };
+struct MeteorState { static const int ID = 2; bool hasExploded; };
+struct EffectShape { static const int ID = 3; float radius; int type; };
+const int COMPONENT_COUNT = 4;
+const size_t COMPONENT_SIZES[COMPONENT_COUNT] = { sizeof(Position), sizeof(Lifetime), sizeof(MeteorState), sizeof(EffectShape) };
+// All entities with one exact set of components. Rows are packed: row r is entry r % capacity of
+// chunk r / capacity, and a chunk holds each component's array at offsets[ID], so a query streams
+// only the arrays it reads.
+struct EntityChunk { alignas(64) unsigned char data[ENTITY_CHUNK_BYTES]; };
+struct Archetype { unsigned mask; int capacity, count; size_t offsets[COMPONENT_COUNT]; std::vector<EntityChunk> chunks; };
+struct World { std::vector<Archetype> archetypes; };
+// A bubble effect waiting to be spawned, e.g. from a parallel job that cannot touch the world.
+struct BubbleEffect { Vector2 position; float radius; int type; int startTime; };
+// Ballistic piece of a ball's path within one sim step; times are in ticks from the start of the step.
+struct BallSegment { float startTime, endTime; Vector2 position, velocity; };
+struct BallPath { BallSegment segments[MAX_BALL_SEGMENTS]; int count; };
+struct BallEvent { double time; int index; unsigned generation; int type; };
+struct BallEventLater { bool operator()(const BallEvent& a, const BallEvent& b) const { return a.time > b.time; } };
+struct ParticleBurst { Vector2 position; float radius, speed; int count; float color[3]; };
+// Structure-of-arrays storage so the update and vertex-building loops vectorize.
+struct ParticleSystem {
+    std::vector<float> x, y, vx, vy, life, decay, r, g, b;
+    std::vector<float> vertices, colors;
+    int count;
+};
+struct SwarmSample { double second; size_t balls, meteors, effects; int particles; double simMs, renderMs, fps; };
+// time is the wall-clock arrival in ms, used to measure input-to-present latency.
+struct InputEvent { int key; bool special, down; double time; };
+// Everything the renderer needs from one simulation update. The simulation fills one of three
+// snapshots while the renderer draws another, so neither ever waits on the other.
+struct GameSnapshot {
+    Player player;
+    Projectile projectiles[MAX_PROJECTILES]; int projectileCount;
+    std::vector<Ball> balls; World world;
+    std::vector<ParticleBurst> particleBursts;
+    bool gameOver, paused; int score, highScore, simTime, gameStartTime; double simMs, autopilotMs;
+    double inputTime;
+};
+// One chunk of a parallel-for: run(context, begin, end, chunk) over the entity range [begin, end).
+struct Job { void (*run)(void*, int, int, int); void* context; int begin, end, chunk; std::atomic<int>* pending; };
+// Fixed ring of jobs; head is the steal end, tail the owner's end.
+struct JobQueue { std::mutex mutex; Job jobs[MAX_QUEUED_JOBS]; unsigned head, tail; };
+// Linear allocator for data that only lives for one sim step. Requests that do not fit are served
+// from the heap and the arena grows to the step's peak on the next reset, so it stops allocating.
+struct FrameArena {
+    std::vector<unsigned char> buffer; size_t used, peak;
+    std::vector<std::vector<unsigned char>> overflow;
+};
+// One gameplay event as written to the telemetry log: sim time in ms, a TELEMETRY_* type, a
+// type-specific detail (weapon, death cause...) and a position plus one value (radius, score...).
+struct TelemetryEvent { int time; short type, detail; float x, y, value; };
+// Sound request from the simulation: a SOUND_* id, gain, stereo pan (-1 left to 1 right) and the
+// wall time it was queued, so the mixer can measure how long it took to be heard.
+struct AudioCommand { int sound; float gain, pan; double queuedAt; };
+// A playing sound: read position into its samples and the per-channel gains. queuedAt is cleared
+// once the first block of it has been output.
+struct Voice { int sound, position; float left, right; double queuedAt; };
+// Autopilot candidate: a ball close enough to matter this horizon, keyed by its horizontal gap.
+struct AutopilotThreat { float gap; int index; };
+// Hold direction (-1, 0, 1) for moveTicks ticks of the horizon, then stand still.
+struct AutopilotPlan { int direction, moveTicks; };
+// Session recording: the header, then one record per step at which the key state changed (keys is
+// left/right/space/invisibility in bits 0-3 and the weapon in bits 4-5) with the score and state
+// hash before that step, so a replay can tell when it has diverged; a record is also written every
+// REPLAY_CHECKPOINT_STEPS steps. A final REPLAY_END record holds the step count. Version 1
+// recordings have no hash and are checked by score only.
+struct ReplayHeader { unsigned magic, version, seed; int stepTicks, flags; };
+struct ReplayRecord { int step, keys, score; unsigned hash; };
+struct BenchResult {
+    const char* session; int ticks, score; double tick[4], frame[4]; long peakKb; long long allocations; bool desync; int desyncStep;
 };
-struct Meteor { Vector2 position; bool isActive, hasExploded; int explosionStartTime; };
-struct BubbleEffect { Vector2 position; float radius; int type; int startTime; float alpha; };
+// Scheduled sim event, linked into one slot of the timer wheel. Nodes live in a fixed pool and a
+// handle is the node index.
+struct TimerNode { long long due; int type, next, prev, slot; };
+// Hierarchical timing wheel on sim ticks: level 0 has one slot per tick, each higher level one slot
+// per TIMER_WHEEL_SLOTS ticks of the level below, cascading down as time reaches it.
+struct TimerWheel {
+    TimerNode nodes[MAX_TIMERS]; int head[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS], tail[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+    int freeList; long long now;
+};
+struct LeaderboardEntry { int score; unsigned seed; int durationMs; time_t date; };
 
 Player player;
 std::vector<Ball> balls;
-std::vector<BubbleEffect> bubbleEffects;
-std::vector<Meteor> meteors;
-Laser laser = { {0, 0}, 0, false };
-bool gameOver = false, leftPressed = false, rightPressed = false, spacePressed = false, invisibilityPressed = false;
-int score = 0, highScore = 0, gameStartTime = 0, lastScoreIncrementTime = 0;
+// Meteors and bubble effects.
+World world;
+const Weapon WEAPONS[WEAPON_COUNT] = {
+    { "LASER", SHOOT_COOLDOWN, 1, 0.0f, LASER_SPEED, 0, true, { 0.0f, 1.0f, 0.0f } },
+    { "SPREAD", 500.0f, 5, 40.0f, 12.0f, 0, false, { 1.0f, 0.8f, 0.2f } },
+    { "RAPID", 90.0f, 1, 0.0f, 18.0f, 0, false, { 0.4f, 0.9f, 1.0f } },
+    { "PIERCE", 350.0f, 1, 0.0f, 15.0f, 3, false, { 1.0f, 0.3f, 1.0f } },
+};
+const QualityTier QUALITY_TIERS[QUALITY_TIER_COUNT] = {
+    { "high", MAX_TRAIL_LENGTH, 1 << 30, 10, true },
+    { "medium", 8, 4000, 15, true },
+    { "low", 4, 1000, 30, false },
+    { "minimal", 0, 250, 45, false },
+};
+template <typename Mode> void UpdateGameMode();
+const GameMode GAME_MODES[GAME_MODE_COUNT] = {
+    { "classic", UpdateGameMode<ClassicMode>, ClassicMode::meteors, ClassicMode::invisibilityUses, ClassicMode::spawnScoreInterval },
+    { "hardcore", UpdateGameMode<HardcoreMode>, HardcoreMode::meteors, HardcoreMode::invisibilityUses, HardcoreMode::spawnScoreInterval },
+    { "no-meteor", UpdateGameMode<NoMeteorMode>, NoMeteorMode::meteors, NoMeteorMode::invisibilityUses, NoMeteorMode::spawnScoreInterval },
+    { "zen", UpdateGameMode<ZenMode>, ZenMode::meteors, ZenMode::invisibilityUses, ZenMode::spawnScoreInterval },
+};
+int gameMode = GAME_MODE_CLASSIC;
+Projectile projectiles[MAX_PROJECTILES];
+int projectileCount = 0;
+bool gameOver = false, paused = false, leftPressed = false, rightPressed = false, spacePressed = false, invisibilityPressed = false;
+// Set by a key going down and cleared once a step has used it, so a tap shorter than a step still counts.
+bool leftTapped = false, rightTapped = false, spaceTapped = false;
+int score = 0, highScore = 0, gameStartTime = 0;
 int lastInvisibilityRewardScore = 0, lastBallSpawnScore = 0, lastMeteorDropTime = 0;
+unsigned gameSeed = 0;
+int simTime = 0, stepStartTime = 0, simStepTicks = 1;
+std::vector<BallPath> ballPaths;
+bool eventPhysics = false, fixedPoint = false, headless = false, seedOverride = false;
+// gameRandomState drives GameRandom in the fixed-point mode; stateHash chains HashState over every step.
+unsigned gameRandomState = 1, stateHash = STATE_HASH_SEED;
+long long headlessTicks = 100000;
+std::priority_queue<BallEvent, std::vector<BallEvent>, BallEventLater> ballEvents;
+std::vector<int> hotBalls;
+unsigned nextBallGeneration = 1;
+long long ballEventsProcessed = 0;
 GLuint backgroundTexture, ufoTexture, meteorTexture;
 
-int GetTime() { return glutGet(GLUT_ELAPSED_TIME); }
+ParticleSystem particles;
+std::vector<ParticleBurst> particleBursts;
+unsigned particleRandomState = 2463534242u;
+int lastParticleUpdateTime = 0;
+int trailLength = 12;
+bool swarmMode = false;
+int swarmBalls = 20000, swarmMeteors = 2000, swarmEffects = 20000, swarmProjectiles = 500;
+float swarmRampSeconds = 60.0f;
+const char* swarmSummaryFile = "swarm_summary.txt";
+std::vector<SwarmSample> swarmSamples;
+SwarmSample swarmCurrent = { 0, 0, 0, 0, 0, 0, 0, 0 };
+double swarmSimMs = 0, swarmRenderMs = 0, swarmWindowStart = 0;
+int swarmFrames = 0;
 
-void LoadHighScore() {
+// The world is drawn at renderScale of the letterboxed view, copied to sceneTexture and stretched
+// to the view; the HUD is always drawn at full resolution.
+int windowWidth = SCREEN_WIDTH, windowHeight = SCREEN_HEIGHT;
+int viewX = 0, viewY = 0, viewWidth = SCREEN_WIDTH, viewHeight = SCREEN_HEIGHT;
+float renderScale = 1.0f, frameBudgetMs = 14.0f;
+double renderMsAverage = 0;
+int lastRenderScaleChange = 0;
+bool dynamicResolution = true;
+// The governor moves qualityTier between bestQualityTier and the last tier together with the scale.
+int qualityTier = 0, bestQualityTier = 0;
+bool adaptiveQuality = true, debugOverlay = false;
+// Software rasterizers draw inside glFinish, so only there is the frame finished before timing it;
+// on hardware that would stall the CPU on the GPU every frame. --finish-frames forces it.
+bool finishFrames = false;
+// Elsewhere frames are timed on the GPU with a ring of GL_TIME_ELAPSED queries, each read back a
+// frame or two late so the CPU never waits on one. gpuFrameMs is the last result read.
+GLuint gpuTimerQueries[GPU_TIMER_QUERIES] = {};
+bool gpuTimerPending[GPU_TIMER_QUERIES] = {};
+int gpuTimerSlot = 0;
+bool gpuTiming = false;
+double gpuFrameMs = 0;
+// Counters for the frame being drawn, charged to renderSubsystem, and the last finished frame.
+RenderCounters renderCounters[RENDER_SUBSYSTEM_COUNT] = {}, lastRenderCounters[RENDER_SUBSYSTEM_COUNT] = {};
+int renderSubsystem = RENDER_FRAME;
+long long renderFrame = 0;
+bool renderStatsOverlay = false;
+const char* renderStatsFile = nullptr;
+FILE* renderStatsOut = nullptr;
+GLuint sceneTexture = 0, staticLayerTexture = 0;
+int sceneTextureWidth = 0, sceneTextureHeight = 0, staticTextureWidth = 0, staticTextureHeight = 0;
+// View size in pixels the cached background and ground were captured at; 0 means not captured yet.
+int staticLayerWidth = 0, staticLayerHeight = 0;
+
+// OpenGL 2.0 entry points, loaded at runtime so the game still starts on 1.x drivers.
+typedef GLuint (APIENTRY* CreateShaderProc)(GLenum type);
+typedef void (APIENTRY* ShaderSourceProc)(GLuint shader, GLsizei count, const char* const* source, const GLint* length);
+typedef void (APIENTRY* CompileShaderProc)(GLuint shader);
+typedef void (APIENTRY* GetShaderivProc)(GLuint shader, GLenum name, GLint* value);
+typedef GLuint (APIENTRY* CreateProgramProc)();
+typedef void (APIENTRY* AttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY* LinkProgramProc)(GLuint program);
+typedef void (APIENTRY* GetProgramivProc)(GLuint program, GLenum name, GLint* value);
+typedef void (APIENTRY* UseProgramProc)(GLuint program);
+typedef void (APIENTRY* GenQueriesProc)(GLsizei count, GLuint* ids);
+typedef void (APIENTRY* BeginQueryProc)(GLenum target, GLuint id);
+typedef void (APIENTRY* EndQueryProc)(GLenum target);
+typedef void (APIENTRY* GetQueryObjectivProc)(GLuint id, GLenum name, GLint* value);
+typedef void (APIENTRY* GetQueryObjectui64vProc)(GLuint id, GLenum name, unsigned long long* value);
+CreateShaderProc glCreateShaderPtr = nullptr;
+ShaderSourceProc glShaderSourcePtr = nullptr;
+CompileShaderProc glCompileShaderPtr = nullptr;
+GetShaderivProc glGetShaderivPtr = nullptr;
+CreateProgramProc glCreateProgramPtr = nullptr;
+AttachShaderProc glAttachShaderPtr = nullptr;
+LinkProgramProc glLinkProgramPtr = nullptr;
+GetProgramivProc glGetProgramivPtr = nullptr;
+UseProgramProc glUseProgramPtr = nullptr;
+GenQueriesProc glGenQueriesPtr = nullptr;
+BeginQueryProc glBeginQueryPtr = nullptr;
+EndQueryProc glEndQueryPtr = nullptr;
+GetQueryObjectivProc glGetQueryObjectivPtr = nullptr;
+GetQueryObjectui64vProc glGetQueryObjectui64vPtr = nullptr;
+GLuint sdfProgram = 0;
+bool useShaders = true;
+std::vector<float> sdfVertices, sdfCoords, sdfColors;
+
+bool threadedSim = false;
+std::thread simulationThread;
+std::atomic<bool> simulationQuit(false);
+InputEvent inputQueue[INPUT_QUEUE_SIZE];
+std::atomic<unsigned> inputQueueHead(0), inputQueueTail(0);
+// Wakes the simulation thread early when a key goes down.
+std::mutex inputWakeMutex;
+std::condition_variable inputWake;
+// Arrival time of the earliest key press applied since the last published snapshot, or -1.
+double stepInputTime = -1.0;
+// Without --threaded: a key press runs the next step ahead of the frame timer, and the timer frame
+// that would have run it only redraws.
+bool timerFrame = false, earlyStepTaken = false;
+// The frame timer drops to IDLE_FRAME_MS while nothing moves (game over, paused, hidden window).
+// Input restarts it at full rate under a new generation; the old chain stops when it next fires.
+int timerGeneration = 0;
+bool timerIdle = false, windowVisible = true;
+bool inputLatency = false;
+std::vector<double> inputLatencySamples;
+double lastInputLatencyMs = -1.0;
+GameSnapshot snapshots[3];
+std::atomic<int> snapshotPending(2);
+int snapshotBack = 0, snapshotFront = 1;
+bool snapshotBackUnread = false;
+std::vector<float> trailVertices, trailColors;
+
+int jobThreads = 0;
+std::thread jobWorkers[MAX_JOB_THREADS];
+JobQueue jobQueues[MAX_JOB_THREADS];
+std::atomic<int> jobsQueued(0);
+std::atomic<bool> jobQuit(false);
+std::mutex jobSleepMutex;
+std::condition_variable jobWake;
+thread_local int jobQueueIndex = 0;
+thread_local std::vector<BubbleEffect>* effectSink = nullptr;
+std::vector<std::vector<BubbleEffect>> ballChunkEffects;
+float* projectileHitTimes = nullptr;
+float* projectileFromTimes = nullptr;
+int* projectileHitTargets = nullptr;
+BallGrid ballGrid, meteorGrid;
+char* meteorImpacts = nullptr;
+FrameArena frameArena;
+bool allocCheck = false;
+TimerWheel timerWheel;
+int scoreTimer = -1, meteorDropTimer = -1, invisibilityTimer = -1;
+// The handle each TIMER_* type is held in, cleared when it fires; sweeps are not held.
+int* const TIMER_HANDLES[] = { &scoreTimer, &meteorDropTimer, &invisibilityTimer, nullptr };
+// Tick each TIMER_* type last fired on, so periodic timers rebase on it rather than the step end.
+long long timerFiredTick[4] = {};
+const AutopilotPlan AUTOPILOT_MOVES[AUTOPILOT_PLANS] = {
+    { 0, 0 }, { -1, AUTOPILOT_HORIZON / 4 }, { 1, AUTOPILOT_HORIZON / 4 }, { -1, AUTOPILOT_HORIZON }, { 1, AUTOPILOT_HORIZON },
+};
+bool autopilot = false;
+const char* recordFile = nullptr;
+FILE* replayRecording = nullptr;
+int replayStep = 0, replayLastKeys = -1;
+std::vector<const char*> benchSessions;
+const char* benchOutFile = "bench_results.csv";
+const char* benchBaselineFile = nullptr;
+float benchThreshold = 10.0f;
+bool benchmark = false, benchRender = false;
+long long autopilotPlanCount = 0;
+double autopilotTotalMs = 0.0, autopilotMaxMs = 0.0, autopilotAverageMs = 0.0;
+
+#ifdef UFO_ALLOC_CHECK
+// Debug builds count every global heap allocation so --alloc-check can prove steady-state ticks
+// allocate nothing.
+std::atomic<long long> heapAllocations(0);
+
+// Every replaceable form is counted, including the aligned ones std::vector<EntityChunk> uses.
+void* CountedAlloc(size_t size, size_t alignment) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
 #ifdef _MSC_VER
-    FILE* file = nullptr;
-    errno_t err = fopen_s(&file, "highscore.txt", "r");
-    if (err != 0 || !file) return;
-    int result = fscanf_s(file, "%d", &highScore);
-    fclose(file);
-    if (result != 1) highScore = 0;
+    return alignment ? _aligned_malloc(size, alignment) : malloc(size);
 #else
-    FILE* file = fopen("highscore.txt", "r");
-    if (file) {
-        int result = fscanf(file, "%d", &highScore);
-        fclose(file);
-        if (result != 1) highScore = 0;
+    return alignment ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : malloc(size);
+#endif
+}
+void* CountedNew(size_t size, size_t alignment) {
+    if (void* p = CountedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void CountedFree(void* p, bool aligned) {
+#ifdef _MSC_VER
+    if (aligned) {
+        _aligned_free(p);
+        return;
     }
+#else
+    (void)aligned;
 #endif
+    free(p);
 }
 
-void SaveHighScore() {
-    if (score <= highScore) return;
-    highScore = score;
+void* operator new(size_t size) { return CountedNew(size, 0); }
+void* operator new[](size_t size) { return CountedNew(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return CountedNew(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return CountedNew(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedAlloc(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedAlloc(size, static_cast<size_t>(alignment)); }
+void operator delete(void* p) noexcept { CountedFree(p, false); }
+void operator delete[](void* p) noexcept { CountedFree(p, false); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p, false); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { CountedFree(p, false); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { CountedFree(p, false); }
+void operator delete(void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { CountedFree(p, true); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { CountedFree(p, true); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { CountedFree(p, true); }
+#endif
+
+// Single-producer (simulation) ring drained by telemetryWriter. The producer keeps its own copy of
+// the consumer's position so an emit normally touches no shared cache line but the tail.
+TelemetryEvent telemetryRing[TELEMETRY_RING_SIZE];
+std::atomic<unsigned> telemetryHead(0), telemetryTail(0);
+unsigned telemetryHeadCache = 0;
+long long telemetryDropped = 0;
+std::atomic<bool> telemetryQuit(false);
+std::thread telemetryWriter;
+const char* telemetryFile = "telemetry.bin";
+bool telemetryEnabled = true, telemetryRequested = false;
+
+// Single-producer (simulation) command ring drained by audioMixer once per block. A full ring drops
+// the sound instead of waiting, so audio never holds up a tick.
+AudioCommand audioRing[AUDIO_QUEUE_SIZE];
+std::atomic<unsigned> audioHead(0), audioTail(0);
+unsigned audioHeadCache = 0;
+long long audioDropped = 0;
+std::atomic<bool> audioQuit(false);
+std::thread audioMixer;
+int audioBackend = DEFAULT_AUDIO;
+bool audioRequested = false;
+const char* audioFile = "audio.wav";
+FILE* audioWav = nullptr;
+long long audioWavFrames = 0;
+#ifdef UFO_ALSA
+snd_pcm_t* audioPcm = nullptr;
+#endif
+std::vector<float> soundSamples[SOUND_COUNT];
+// Mixer statistics, owned by the mixer thread and read once it has been joined.
+std::vector<double> audioLatencySamples;
+long long audioBlocks = 0, audioVoiceBlocks = 0, audioUnderruns = 0, audioStolen = 0;
+double audioMixMs = 0.0, audioMaxMixMs = 0.0;
+int audioPeakVoices = 0;
+
+std::vector<LeaderboardEntry> leaderboard, pendingLeaderboard;
+std::thread leaderboardWriter;
+std::mutex leaderboardMutex;
+std::condition_variable leaderboardCondition;
+bool leaderboardDirty = false, leaderboardWriterQuit = false;
+
+int GetTime() { return simTime; }
+int GetWallTime() {
+    static const auto start = std::chrono::steady_clock::now();
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+double GetWallMillis() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+double SimTicks() { return static_cast<double>(simTime) / SIM_TICK_MS; }
+int StepTime(float t) { return stepStartTime + static_cast<int>(t * SIM_TICK_MS); }
+
+// Gameplay randomness. rand() differs between C libraries, so the fixed-point mode draws from its
+// own xorshift stream instead and replays the same everywhere.
+int GameRandom() {
+    if (!fixedPoint) return rand();
+    gameRandomState ^= gameRandomState << 13;
+    gameRandomState ^= gameRandomState >> 17;
+    gameRandomState ^= gameRandomState << 5;
+    return static_cast<int>(gameRandomState >> 1);
+}
+
+void SeedGameRandom() {
+    srand(gameSeed);
+    gameRandomState = gameSeed << 1 | 1;
+}
+
+// Float inputs to the fixed-point mode are whole or halved pixel values, so these conversions are exact.
+Fixed ToFixed(float value) { return static_cast<Fixed>(lroundf(value * FIXED_ONE)); }
+FixedVector ToFixed(Vector2 value) { return { ToFixed(value.x), ToFixed(value.y) }; }
+float FromFixed(Fixed value) { return static_cast<float>(value) / FIXED_ONE; }
+Vector2 FromFixed(FixedVector value) { return { FromFixed(value.x), FromFixed(value.y) }; }
+Fixed FixedMul(Fixed a, Fixed b) { return static_cast<Fixed>(static_cast<long long>(a) * b / FIXED_ONE); }
+
+// Square root of a Q32.32 value as Q16.16, by the bitwise integer method.
+Fixed FixedSqrt(long long value) {
+    unsigned long long remainder = static_cast<unsigned long long>(std::max(value, 0LL)), root = 0, bit = 1ULL << 62;
+    while (bit > remainder) bit >>= 2;
+    while (bit != 0) {
+        if (remainder >= root + bit) {
+            remainder -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return static_cast<Fixed>(root);
+}
+
+// Sine and cosine of an angle in degrees by Taylor series, good to a few units in the last place up
+// to 30 degrees (the widest spread shot).
+void FixedSinCos(Fixed degrees, Fixed& sine, Fixed& cosine) {
+    Fixed x = FixedMul(degrees, FIXED_DEGREE), x2 = FixedMul(x, x), sineTerm = x, cosineTerm = FIXED_ONE;
+    sine = x;
+    cosine = FIXED_ONE;
+    for (int n = 1; n <= 4; ++n) {
+        sineTerm = -FixedMul(sineTerm, x2) / ((2 * n) * (2 * n + 1));
+        cosineTerm = -FixedMul(cosineTerm, x2) / ((2 * n - 1) * (2 * n));
+        sine += sineTerm;
+        cosine += cosineTerm;
+    }
+}
+
+bool FixedOverlap(FixedVector a, FixedVector b, Fixed reach) {
+    long long dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy < static_cast<long long>(reach) * reach;
+}
+
+// p50, p95, p99 and max of samples (sorted in place), or -1 when there are none.
+void Percentiles(std::vector<double>& samples, double out[4]) {
+    if (samples.empty()) {
+        for (int i = 0; i < 4; ++i) out[i] = -1.0;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const double quantiles[3] = { 0.50, 0.95, 0.99 };
+    for (int i = 0; i < 3; ++i) out[i] = samples[std::min(samples.size() - 1, static_cast<size_t>(quantiles[i] * samples.size()))];
+    out[3] = samples.back();
+}
+
+void LoadHighScore() {
+    leaderboard.clear();
+    highScore = 0;
 #ifdef _MSC_VER
     FILE* file = nullptr;
-    errno_t err = fopen_s(&file, "highscore.txt", "w");
-    if (err != 0 || !file) return;
-    fprintf(file, "%d", highScore);
+    if (fopen_s(&file, LEADERBOARD_FILE, "r") != 0) file = nullptr;
+#else
+    FILE* file = fopen(LEADERBOARD_FILE, "r");
+#endif
+    if (!file) return;
+    char line[128];
+    while (fgets(line, sizeof(line), file) && static_cast<int>(leaderboard.size()) < LEADERBOARD_SIZE) {
+        LeaderboardEntry entry = { 0, 0, 0, 0 };
+        long long date = 0;
+        // Older builds wrote a bare integer; the remaining fields then stay zero.
+        if (sscanf(line, "%d %u %d %lld", &entry.score, &entry.seed, &entry.durationMs, &date) < 1) continue;
+        entry.date = static_cast<time_t>(date);
+        leaderboard.push_back(entry);
+    }
     fclose(file);
+    std::sort(leaderboard.begin(), leaderboard.end(),
+        [](const LeaderboardEntry& a, const LeaderboardEntry& b) { return a.score > b.score; });
+    if (!leaderboard.empty()) highScore = leaderboard[0].score;
+}
+
+bool WriteLeaderboardFile(const std::vector<LeaderboardEntry>& entries) {
+    char tempName[64];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", LEADERBOARD_FILE);
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, tempName, "w") != 0 || !file) return false;
+#else
+    FILE* file = fopen(tempName, "w");
+    if (!file) return false;
+#endif
+    bool ok = true;
+    for (const auto& entry : entries) {
+        if (fprintf(file, "%d %u %d %lld\n", entry.score, entry.seed, entry.durationMs, static_cast<long long>(entry.date)) < 0) ok = false;
+    }
+    if (fflush(file) != 0) ok = false;
+    // The data must be on disk before the rename, or a power loss can leave an empty leaderboard.
+#ifdef _MSC_VER
+    if (_commit(_fileno(file)) != 0) ok = false;
 #else
-    FILE* file = fopen("highscore.txt", "w");
-    if (file) {
-        fprintf(file, "%d", highScore);
-        fclose(file);
+    if (fsync(fileno(file)) != 0) ok = false;
+#endif
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        remove(tempName);
+        return false;
     }
+#ifdef _MSC_VER
+    // rename() refuses to replace an existing file on Windows; this replaces it in one step.
+    return MoveFileExA(tempName, LEADERBOARD_FILE, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(tempName, LEADERBOARD_FILE) == 0;
 #endif
 }
 
-void SpawnBall(float x, float y, float radius) {
-    Ball ball;
-    ball.position = { x, y };
-    ball.radius = radius;
-    float speed = 1.0f + static_cast<float>(rand()) / RAND_MAX * 0.3f;
-    float direction = (rand() % 2 ? 1.0f : -1.0f);
-    ball.velocity = { direction * (2.0f + radius / 15.0f) * speed, -1.5f };
-    ball.points = static_cast<int>(100.0f / (radius / 10.0f));
-    balls.push_back(ball);
+void LeaderboardWriterMain() {
+    std::vector<LeaderboardEntry> entries;
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    for (;;) {
+        leaderboardCondition.wait(lock, [] { return leaderboardDirty || leaderboardWriterQuit; });
+        if (!leaderboardDirty) break;
+        entries.swap(pendingLeaderboard);
+        leaderboardDirty = false;
+        lock.unlock();
+        if (!WriteLeaderboardFile(entries)) std::cerr << "Failed to save leaderboard: " << LEADERBOARD_FILE << std::endl;
+        lock.lock();
+    }
 }
 
-void SpawnRandomBall() {
-    float x = 100.0f + static_cast<float>(rand() % (SCREEN_WIDTH - 200));
-    float radius = 20.0f + static_cast<float>(rand() % 41);
-    SpawnBall(x, 100, radius);
-    lastBallSpawnScore = score;
+void StartLeaderboardWriter() {
+    leaderboardWriter = std::thread(LeaderboardWriterMain);
 }
 
-void CheckBallSpawn() {
-    int spawnIntervals = score / BALL_SPAWN_SCORE_INTERVAL;
-    int lastSpawnIntervals = lastBallSpawnScore / BALL_SPAWN_SCORE_INTERVAL;
-    if (spawnIntervals > lastSpawnIntervals || (balls.empty() && score > lastBallSpawnScore)) {
-        SpawnRandomBall();
+void StopLeaderboardWriter() {
+    if (!leaderboardWriter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(leaderboardMutex);
+        leaderboardWriterQuit = true;
     }
+    leaderboardCondition.notify_one();
+    leaderboardWriter.join();
 }
 
-void SplitBall(int index) {
-    BubbleEffect effect = { balls[index].position, balls[index].radius, BUBBLE_EFFECT_SPLIT, GetTime(), 1.0f };
-    bubbleEffects.push_back(effect);
-    score += balls[index].points;
+void SaveHighScore() {
+    // Headless sessions and benchmarks are tooling runs and must not touch the player's leaderboard,
+    // and only classic games are ranked.
+    if (headless || benchmark || gameMode != GAME_MODE_CLASSIC) return;
+    LeaderboardEntry entry = { score, gameSeed, GetTime() - gameStartTime, time(nullptr) };
+    auto pos = std::upper_bound(leaderboard.begin(), leaderboard.end(), entry,
+        [](const LeaderboardEntry& a, const LeaderboardEntry& b) { return a.score > b.score; });
+    if (pos - leaderboard.begin() >= LEADERBOARD_SIZE) return;
+    leaderboard.insert(pos, entry);
+    if (static_cast<int>(leaderboard.size()) > LEADERBOARD_SIZE) leaderboard.pop_back();
+    highScore = leaderboard[0].score;
+    {
+        std::lock_guard<std::mutex> lock(leaderboardMutex);
+        pendingLeaderboard = leaderboard;
+        leaderboardDirty = true;
+    }
+    leaderboardCondition.notify_one();
+}
 
-    if (balls[index].radius > 20) {
-        float newRadius = balls[index].radius / 2;
-        Ball newBall1 = balls[index];
-        newBall1.radius = newRadius;
-        newBall1.velocity = { balls[index].velocity.x + 1.5f, -balls[index].velocity.y };
-        newBall1.points = balls[index].points * 2;
-        Ball newBall2 = balls[index];
-        newBall2.radius = newRadius;
-        newBall2.velocity = { -balls[index].velocity.x - 1.5f, -balls[index].velocity.y };
-        newBall2.points = balls[index].points * 2;
-        balls.push_back(newBall1);
-        balls.push_back(newBall2);
+inline void EmitTelemetry(int type, int detail, float x, float y, float value) {
+    if (!telemetryEnabled) return;
+    unsigned tail = telemetryTail.load(std::memory_order_relaxed);
+    if (tail - telemetryHeadCache >= TELEMETRY_RING_SIZE) {
+        telemetryHeadCache = telemetryHead.load(std::memory_order_acquire);
+        if (tail - telemetryHeadCache >= TELEMETRY_RING_SIZE) {
+            ++telemetryDropped;
+            return;
+        }
     }
+    telemetryRing[tail % TELEMETRY_RING_SIZE] = { simTime, static_cast<short>(type), static_cast<short>(detail), x, y, value };
+    telemetryTail.store(tail + 1, std::memory_order_release);
+}
 
-    balls.erase(balls.begin() + index);
-    CheckBallSpawn();
+// Log layout: "UFOT", format version and record size (uint32 each), then raw TelemetryEvent records.
+void TelemetryWriterMain(FILE* file) {
+    const unsigned header[3] = { 0x544F4655u, 1u, static_cast<unsigned>(sizeof(TelemetryEvent)) };
+    fwrite(header, sizeof(header), 1, file);
+    for (;;) {
+        bool quit = telemetryQuit.load(std::memory_order_acquire);
+        unsigned head = telemetryHead.load(std::memory_order_relaxed);
+        unsigned tail = telemetryTail.load(std::memory_order_acquire);
+        while (head != tail) {
+            unsigned start = head % TELEMETRY_RING_SIZE;
+            unsigned count = std::min(tail - head, TELEMETRY_RING_SIZE - start);
+            fwrite(telemetryRing + start, sizeof(TelemetryEvent), count, file);
+            head += count;
+        }
+        telemetryHead.store(head, std::memory_order_release);
+        if (quit) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_FLUSH_MS));
+    }
+    fclose(file);
 }
 
-bool CheckLaserCollision(const Ball& ball) {
-    if (!laser.isActive) return false;
-    float dx = fabs(ball.position.x - laser.startX);
-    return dx <= ball.radius && ball.position.y >= laser.position.y && ball.position.y <= player.position.y;
+void StartTelemetryWriter() {
+    if (!telemetryEnabled) return;
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, telemetryFile, "wb") != 0) file = nullptr;
+#else
+    FILE* file = fopen(telemetryFile, "wb");
+#endif
+    if (!file) {
+        std::cerr << "Failed to open telemetry log: " << telemetryFile << std::endl;
+        telemetryEnabled = false;
+        return;
+    }
+    telemetryWriter = std::thread(TelemetryWriterMain, file);
 }
 
-//bool CheckLaserCollision(const Meteor& meteor) {
-//    if (!laser.isActive || meteor.hasExploded) return false;
-//    float dist = sqrt(pow(laser.startX - meteor.position.x, 2) + pow(laser.position.y - meteor.position.y, 2));
-//    return dist <= 20.0f;
-//}
+void StopTelemetryWriter() {
+    if (!telemetryWriter.joinable()) return;
+    telemetryQuit.store(true, std::memory_order_release);
+    telemetryWriter.join();
+    if (telemetryDropped > 0) std::cerr << "Telemetry dropped " << telemetryDropped << " events" << std::endl;
+}
 
-void ShootLaser() {
-    int now = GetTime();
-    if (!laser.isActive && now - player.lastShootTime >= SHOOT_COOLDOWN) {
-        laser = { {player.position.x, player.position.y}, player.position.x, true };
-        player.lastShootTime = now;
-        /*for (size_t i = 0; i < meteors.size(); ++i) {
-            if (!meteors[i].hasExploded && CheckLaserCollision(meteors[i])) {
-                meteors[i].hasExploded = true;
-                meteors[i].explosionStartTime = now;
-                laser.isActive = false;
+// Queue a sound from the simulation; never blocks. x places it in the stereo field.
+inline void QueueSound(int sound, float x, float gain = 1.0f) {
+    if (audioBackend == AUDIO_OFF) return;
+    unsigned tail = audioTail.load(std::memory_order_relaxed);
+    if (tail - audioHeadCache >= AUDIO_QUEUE_SIZE) {
+        audioHeadCache = audioHead.load(std::memory_order_acquire);
+        if (tail - audioHeadCache >= AUDIO_QUEUE_SIZE) {
+            ++audioDropped;
+            return;
+        }
+    }
+    float pan = std::max(-1.0f, std::min(1.0f, x / SCREEN_WIDTH * 2.0f - 1.0f));
+    audioRing[tail % AUDIO_QUEUE_SIZE] = { sound, gain, pan, GetWallMillis() };
+    audioTail.store(tail + 1, std::memory_order_release);
+}
+
+// The sounds are synthesized once at start-up rather than loaded, so there are no asset files.
+void SynthesizeSounds() {
+    const float lengths[SOUND_COUNT] = { 0.12f, 0.08f, 0.18f, 0.9f, 0.6f };
+    const float twoPi = 2.0f * static_cast<float>(M_PI);
+    unsigned noise = 0x9E3779B9u;
+    for (int s = 0; s < SOUND_COUNT; ++s) {
+        int frames = static_cast<int>(lengths[s] * AUDIO_RATE);
+        soundSamples[s].resize(frames);
+        float phase = 0.0f, rumble = 0.0f;
+        for (int i = 0; i < frames; ++i) {
+            float t = static_cast<float>(i) / AUDIO_RATE, u = static_cast<float>(i) / frames;
+            noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5;
+            float white = static_cast<float>(noise) / 2147483648.0f - 1.0f, value;
+            switch (s) {
+            case SOUND_LASER:
+                phase += (1800.0f - 1400.0f * u) / AUDIO_RATE;
+                value = (phase - floorf(phase) < 0.5f ? 0.3f : -0.3f) * (1.0f - u);
+                break;
+            case SOUND_POP:
+                phase += (700.0f - 500.0f * u) / AUDIO_RATE;
+                value = (0.6f * sinf(twoPi * phase) + 0.2f * white) * expf(-60.0f * t);
+                break;
+            case SOUND_SPLIT:
+                phase += (440.0f - 90.0f * u) / AUDIO_RATE;
+                value = 0.3f * (sinf(twoPi * phase) + sinf(1.5f * twoPi * phase)) * expf(-18.0f * t);
+                break;
+            case SOUND_METEOR:
+                rumble += 0.05f * (white - rumble);
+                value = (2.0f * rumble + 0.4f * sinf(twoPi * 55.0f * t)) * expf(-4.0f * t);
+                break;
+            default:
+                phase += (300.0f + 900.0f * u) / AUDIO_RATE;
+                value = 0.35f * sinf(twoPi * phase) * sinf(static_cast<float>(M_PI) * u) * (0.75f + 0.25f * sinf(twoPi * 12.0f * t));
                 break;
             }
-        }*/
+            soundSamples[s][i] = value;
+        }
     }
 }
 
-void ActivateInvisibility() {
-    if (player.remainingInvisibilityUses > 0 && !player.isInvisible) {
-        player.isInvisible = true;
-        player.invisibilityStartTime = GetTime();
-        player.remainingInvisibilityUses--;
+// Add n mono samples into the 16-byte aligned left/right mix buffers, four at a time with SSE2.
+void MixVoice(float* left, float* right, const float* samples, int n, float leftGain, float rightGain) {
+    int i = 0;
+#ifdef UFO_SSE2
+    __m128 leftGains = _mm_set1_ps(leftGain), rightGains = _mm_set1_ps(rightGain);
+    for (; i + 4 <= n; i += 4) {
+        __m128 value = _mm_loadu_ps(samples + i);
+        _mm_store_ps(left + i, _mm_add_ps(_mm_load_ps(left + i), _mm_mul_ps(value, leftGains)));
+        _mm_store_ps(right + i, _mm_add_ps(_mm_load_ps(right + i), _mm_mul_ps(value, rightGains)));
+    }
+#endif
+    for (; i < n; ++i) {
+        left[i] += samples[i] * leftGain;
+        right[i] += samples[i] * rightGain;
     }
 }
 
-void DropMeteor() {
-    Meteor meteor = { {static_cast<float>(rand() % (SCREEN_WIDTH - 100) + 50), 0}, true, false, 0 };
-    meteors.push_back(meteor);
-    lastMeteorDropTime = GetTime();
+// Scale and clamp the mix and interleave it into 16-bit stereo frames.
+void ConvertAudioBlock(const float* left, const float* right, short* frames, int n) {
+    const float scale = 32767.0f * AUDIO_MASTER_GAIN;
+    int i = 0;
+#ifdef UFO_SSE2
+    __m128 scales = _mm_set1_ps(scale), low = _mm_set1_ps(-32768.0f), high = _mm_set1_ps(32767.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128i l = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_load_ps(left + i), scales), low), high));
+        __m128i r = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_load_ps(right + i), scales), low), high));
+        __m128i packed = _mm_packs_epi32(l, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(frames + 2 * i), _mm_unpacklo_epi16(packed, _mm_unpackhi_epi64(packed, packed)));
+    }
+#endif
+    for (; i < n; ++i) {
+        frames[2 * i] = static_cast<short>(lrintf(std::max(-32768.0f, std::min(32767.0f, left[i] * scale))));
+        frames[2 * i + 1] = static_cast<short>(lrintf(std::max(-32768.0f, std::min(32767.0f, right[i] * scale))));
+    }
 }
 
-void UpdateMeteors() {
-    int now = GetTime();
-    for (auto& meteor : meteors) {
-        if (!meteor.hasExploded) {
-            meteor.position.y += METEOR_FALL_SPEED;
-            if (meteor.position.y >= SCREEN_HEIGHT - 10) {
-                meteor.hasExploded = true;
-                meteor.explosionStartTime = now;
+void WriteWavHeader(FILE* file, unsigned dataBytes) {
+    const unsigned format[4] = { 16u, 1u | (2u << 16), static_cast<unsigned>(AUDIO_RATE), static_cast<unsigned>(AUDIO_RATE) * 4 };
+    const unsigned short frameLayout[2] = { 4, 16 };
+    unsigned riffBytes = 36 + dataBytes;
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riffBytes, sizeof(riffBytes), 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(format, sizeof(format), 1, file);
+    fwrite(frameLayout, sizeof(frameLayout), 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&dataBytes, sizeof(dataBytes), 1, file);
+}
+
+// Sleep until the output can take the next block. ALSA is waited on directly; the null and WAV
+// outputs keep to real time on the wall clock, catching up (as an underrun) if the mixer fell behind.
+void WaitForAudioOutput(double& due) {
+    const double blockMs = 1000.0 * AUDIO_BLOCK_FRAMES / AUDIO_RATE;
+#ifdef UFO_ALSA
+    if (audioBackend == AUDIO_ALSA) {
+        while (!audioQuit.load(std::memory_order_acquire)) {
+            snd_pcm_sframes_t available = snd_pcm_avail_update(audioPcm);
+            if (available < 0) {
+                ++audioUnderruns;
+                snd_pcm_recover(audioPcm, static_cast<int>(available), 1);
             }
-            if (meteor.hasExploded && !player.isInvisible) {
-                float dist = sqrt(pow(player.position.x - meteor.position.x, 2) + pow(player.position.y - meteor.position.y, 2));
-                if (dist < METEOR_EXPLOSION_RADIUS) {
-                    gameOver = true;
-                    SaveHighScore();
+            else if (available >= AUDIO_BLOCK_FRAMES) break;
+            else snd_pcm_wait(audioPcm, 10);
+        }
+        return;
+    }
+#endif
+    double now = GetWallMillis();
+    if (now > due + blockMs) {
+        ++audioUnderruns;
+        due = now;
+    }
+    else if (due > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>((due - now) * 1000.0)));
+    }
+    due += blockMs;
+}
+
+// Hand a mixed block to the output and return how long until its first frame is heard, in ms.
+double OutputAudioBlock(const short* frames) {
+#ifdef UFO_ALSA
+    if (audioBackend == AUDIO_ALSA) {
+        snd_pcm_sframes_t written = snd_pcm_writei(audioPcm, frames, AUDIO_BLOCK_FRAMES);
+        if (written < 0) {
+            ++audioUnderruns;
+            snd_pcm_recover(audioPcm, static_cast<int>(written), 1);
+            snd_pcm_writei(audioPcm, frames, AUDIO_BLOCK_FRAMES);
+        }
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(audioPcm, &delay) < 0) delay = 0;
+        return 1000.0 * std::max<snd_pcm_sframes_t>(delay - AUDIO_BLOCK_FRAMES, 0) / AUDIO_RATE;
+    }
+#endif
+    if (audioBackend == AUDIO_WAV) {
+        fwrite(frames, sizeof(short) * 2, AUDIO_BLOCK_FRAMES, audioWav);
+        audioWavFrames += AUDIO_BLOCK_FRAMES;
+    }
+    return 0.0;
+}
+
+void AudioMixerMain() {
+    alignas(16) float left[AUDIO_BLOCK_FRAMES], right[AUDIO_BLOCK_FRAMES];
+    alignas(16) short frames[AUDIO_BLOCK_FRAMES * 2];
+    Voice voices[MAX_VOICES];
+    int voiceCount = 0;
+    double due = GetWallMillis();
+    for (;;) {
+        WaitForAudioOutput(due);
+        if (audioQuit.load(std::memory_order_acquire)) break;
+        auto mixStart = std::chrono::steady_clock::now();
+        // Start the queued sounds, stealing the voice furthest through its sound when all are busy.
+        unsigned head = audioHead.load(std::memory_order_relaxed);
+        unsigned tail = audioTail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const AudioCommand& command = audioRing[head % AUDIO_QUEUE_SIZE];
+            int slot = voiceCount;
+            if (voiceCount < MAX_VOICES) ++voiceCount;
+            else {
+                slot = 0;
+                for (int v = 1; v < MAX_VOICES; ++v) {
+                    if (voices[v].position > voices[slot].position) slot = v;
                 }
+                ++audioStolen;
+            }
+            float angle = (command.pan + 1.0f) * 0.25f * static_cast<float>(M_PI);
+            voices[slot] = { command.sound, 0, cosf(angle) * command.gain, sinf(angle) * command.gain, command.queuedAt };
+        }
+        audioHead.store(head, std::memory_order_release);
+        audioPeakVoices = std::max(audioPeakVoices, voiceCount);
+        audioVoiceBlocks += voiceCount;
+
+        std::fill(left, left + AUDIO_BLOCK_FRAMES, 0.0f);
+        std::fill(right, right + AUDIO_BLOCK_FRAMES, 0.0f);
+        for (int v = 0; v < voiceCount; ++v) {
+            Voice& voice = voices[v];
+            const std::vector<float>& samples = soundSamples[voice.sound];
+            int count = std::min(AUDIO_BLOCK_FRAMES, static_cast<int>(samples.size()) - voice.position);
+            MixVoice(left, right, samples.data() + voice.position, count, voice.left, voice.right);
+            voice.position += count;
+        }
+        ConvertAudioBlock(left, right, frames, AUDIO_BLOCK_FRAMES);
+        double mixMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mixStart).count();
+        audioMixMs += mixMs;
+        audioMaxMixMs = std::max(audioMaxMixMs, mixMs);
+        ++audioBlocks;
+
+        double heardAt = GetWallMillis() + OutputAudioBlock(frames);
+        for (int v = 0; v < voiceCount;) {
+            Voice& voice = voices[v];
+            if (voice.queuedAt >= 0.0) {
+                audioLatencySamples.push_back(heardAt - voice.queuedAt);
+                voice.queuedAt = -1.0;
             }
+            if (voice.position >= static_cast<int>(soundSamples[voice.sound].size())) voice = voices[--voiceCount];
+            else ++v;
         }
     }
-    meteors.erase(std::remove_if(meteors.begin(), meteors.end(),
-        [](const Meteor& m) { return m.hasExploded && GetTime() - m.explosionStartTime > 1000; }), meteors.end());
 }
 
-void UpdateInvisibilityStatus() {
-    if (player.isInvisible && GetTime() - player.invisibilityStartTime >= INVISIBILITY_DURATION) {
-        player.isInvisible = false;
+void StartAudio() {
+    if (audioBackend == AUDIO_OFF) return;
+    if (audioBackend == AUDIO_WAV) {
+#ifdef _MSC_VER
+        if (fopen_s(&audioWav, audioFile, "wb") != 0) audioWav = nullptr;
+#else
+        audioWav = fopen(audioFile, "wb");
+#endif
+        if (!audioWav) {
+            std::cerr << "Failed to open audio output: " << audioFile << std::endl;
+            audioBackend = AUDIO_OFF;
+            return;
+        }
+        WriteWavHeader(audioWav, 0);
     }
+#ifdef UFO_ALSA
+    if (audioBackend == AUDIO_ALSA) {
+        int error = snd_pcm_open(&audioPcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+        if (error >= 0) error = snd_pcm_set_params(audioPcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 2, AUDIO_RATE, 1, ALSA_LATENCY_US);
+        if (error < 0) {
+            std::cerr << "Failed to open ALSA output: " << snd_strerror(error) << std::endl;
+            if (audioPcm) snd_pcm_close(audioPcm);
+            audioPcm = nullptr;
+            audioBackend = AUDIO_OFF;
+            return;
+        }
+    }
+#endif
+    SynthesizeSounds();
+    audioLatencySamples.reserve(4096);
+    audioMixer = std::thread(AudioMixerMain);
 }
 
-void HandleInput() {
-    player.isMoving = false;
-    if (leftPressed) {
-        player.position.x -= PLAYER_SPEED;
-        player.isMoving = true;
-        player.direction = 1.0f;
+void StopAudio() {
+    if (!audioMixer.joinable()) return;
+    audioQuit.store(true, std::memory_order_release);
+    audioMixer.join();
+    if (audioWav) {
+        fseek(audioWav, 0, SEEK_SET);
+        WriteWavHeader(audioWav, static_cast<unsigned>(audioWavFrames * 4));
+        fclose(audioWav);
+        audioWav = nullptr;
     }
-    if (rightPressed) {
-        player.position.x += PLAYER_SPEED;
-        player.isMoving = true;
-        player.direction = -1.0f;
+#ifdef UFO_ALSA
+    if (audioPcm) {
+        snd_pcm_drain(audioPcm);
+        snd_pcm_close(audioPcm);
+        audioPcm = nullptr;
+    }
+#endif
+    if (audioBlocks == 0) return;
+    const double blockMs = 1000.0 * AUDIO_BLOCK_FRAMES / AUDIO_RATE;
+    double perVoiceUs = audioVoiceBlocks > 0 ? 1000.0 * audioMixMs / audioVoiceBlocks : 0.0;
+    printf("audio: %lld blocks of %.2f ms, mix %.3f ms avg / %.3f ms max, %.3f us per voice per block (%.3f%% of a core), peak %d voices, %lld stolen, %lld dropped, %lld underruns\n",
+        audioBlocks, blockMs, audioMixMs / audioBlocks, audioMaxMixMs, perVoiceUs, perVoiceUs / (10.0 * blockMs),
+        audioPeakVoices, audioStolen, audioDropped, audioUnderruns);
+    if (!audioLatencySamples.empty()) {
+        double stats[4];
+        Percentiles(audioLatencySamples, stats);
+        printf("audio queue-to-output latency over %zu sounds: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+            audioLatencySamples.size(), stats[0], stats[1], stats[2], stats[3]);
     }
-    if (spacePressed) ShootLaser();
-    if (invisibilityPressed) { ActivateInvisibility(); invisibilityPressed = false; }
-    player.position.x = std::max(player.width / 2, std::min(SCREEN_WIDTH - player.width / 2, player.position.x));
 }
 
-void UpdateScore() {
-    int now = GetTime();
-    if (now - lastScoreIncrementTime >= 1000) {
-        score += 10;
-        lastScoreIncrementTime = now;
-        CheckBallSpawn();
-        int invisibilityRewards = score / INVISIBILITY_REWARD_INTERVAL;
-        int newRewards = invisibilityRewards - (lastInvisibilityRewardScore / INVISIBILITY_REWARD_INTERVAL);
-        if (newRewards > 0) {
-            player.remainingInvisibilityUses += newRewards;
-            lastInvisibilityRewardScore = invisibilityRewards * INVISIBILITY_REWARD_INTERVAL;
-        }
+void StartReplayRecording() {
+    if (!recordFile) return;
+    if (swarmMode) {
+        std::cerr << "Swarm sessions cannot be recorded" << std::endl;
+        return;
+    }
+#ifdef _MSC_VER
+    if (fopen_s(&replayRecording, recordFile, "wb") != 0) replayRecording = nullptr;
+#else
+    replayRecording = fopen(recordFile, "wb");
+#endif
+    if (!replayRecording) {
+        std::cerr << "Failed to open recording: " << recordFile << std::endl;
+        return;
     }
+    int flags = (eventPhysics ? REPLAY_EVENT_PHYSICS : 0) | (fixedPoint ? REPLAY_FIXED_POINT : 0) | gameMode << REPLAY_MODE_SHIFT;
+    ReplayHeader header = { REPLAY_MAGIC, REPLAY_VERSION, gameSeed, simStepTicks, flags };
+    fwrite(&header, sizeof(header), 1, replayRecording);
+    replayStep = 0;
+    replayLastKeys = -1;
 }
 
-void RenderShape(float x, float y, float width, float height, float r, float g, float b, float alpha, bool isCircle = false) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(r, g, b, alpha);
-    if (isCircle) {
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(x, y);
-        for (int i = 0; i <= 360; i += 10) {
-            float angle = i * M_PI / 180;
-            glVertex2f(x + cos(angle) * width, y + sin(angle) * height);
-        }
-        glEnd();
-        glColor4f(1.0f, 1.0f, 1.0f, alpha);
-        glBegin(GL_LINE_LOOP);
-        for (int i = 0; i <= 360; i += 10) {
-            float angle = i * M_PI / 180;
-            glVertex2f(x + cos(angle) * width, y + sin(angle) * height);
-        }
-        glEnd();
+// Only the first game is recorded; this runs when it ends or the program exits.
+void StopReplayRecording() {
+    if (!replayRecording) return;
+    ReplayRecord end = { replayStep, REPLAY_END, score, stateHash };
+    fwrite(&end, sizeof(end), 1, replayRecording);
+    fclose(replayRecording);
+    replayRecording = nullptr;
+}
+
+int ReplayKeys() {
+    return (leftPressed || leftTapped ? 1 : 0) | (rightPressed || rightTapped ? 2 : 0) | (spacePressed || spaceTapped ? 4 : 0)
+        | (invisibilityPressed ? 8 : 0) | (player.weapon << 4);
+}
+
+void ApplyReplayKeys(int keys) {
+    leftPressed = (keys & 1) != 0;
+    rightPressed = (keys & 2) != 0;
+    spacePressed = (keys & 4) != 0;
+    invisibilityPressed = (keys & 8) != 0;
+    player.weapon = (keys >> 4) & 3;
+}
+
+void RecordReplayInput() {
+    int keys = ReplayKeys();
+    if (keys != replayLastKeys || replayStep % REPLAY_CHECKPOINT_STEPS == 0) {
+        ReplayRecord record = { replayStep, keys, score, stateHash };
+        fwrite(&record, sizeof(record), 1, replayRecording);
+        replayLastKeys = keys;
     }
-    else {
-        glBegin(GL_QUADS);
-        glVertex2f(x - width / 2, y - height / 2);
-        glVertex2f(x + width / 2, y - height / 2);
-        glVertex2f(x + width / 2, y + height / 2);
-        glVertex2f(x - width / 2, y + height / 2);
-        glEnd();
+    ++replayStep;
+}
+
+void KillPlayer(int cause) {
+    if (gameOver || swarmMode) return;
+    gameOver = true;
+    EmitTelemetry(TELEMETRY_DEATH, cause, player.position.x, player.position.y, static_cast<float>(score));
+    SaveHighScore();
+}
+
+// Work-stealing job system. Each thread owns a job ring: it pops its own jobs from the back and,
+// when empty, steals from the front of the others. Work is always split into the same chunks whatever
+// the thread count, and per-chunk results are merged in chunk order, so the simulation stays
+// deterministic.
+bool TryRunJob() {
+    if (jobsQueued.load(std::memory_order_acquire) == 0) return false;
+    Job job;
+    bool found = false;
+    for (int k = 0; k < jobThreads && !found; ++k) {
+        JobQueue& queue = jobQueues[(jobQueueIndex + k) % jobThreads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.head == queue.tail) continue;
+        if (k == 0) job = queue.jobs[--queue.tail % MAX_QUEUED_JOBS];
+        else job = queue.jobs[queue.head++ % MAX_QUEUED_JOBS];
+        found = true;
     }
-    glDisable(GL_BLEND);
+    if (!found) return false;
+    jobsQueued.fetch_sub(1, std::memory_order_relaxed);
+    job.run(job.context, job.begin, job.end, job.chunk);
+    job.pending->fetch_sub(1, std::memory_order_release);
+    return true;
 }
 
-void RenderTexture(GLuint texture, float x, float y, float width, float height, float alpha, bool flipX = false) {
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(1.0f, 1.0f, 1.0f, alpha);
-    glPushMatrix();
-    glTranslatef(x, y, 0.0f);
-    if (flipX) glScalef(-1.0f, 1.0f, 1.0f);
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, 0.0f); glVertex2f(-width / 2, -height / 2);
-    glTexCoord2f(1.0f, 0.0f); glVertex2f(width / 2, -height / 2);
-    glTexCoord2f(1.0f, 1.0f); glVertex2f(width / 2, height / 2);
-    glTexCoord2f(0.0f, 1.0f); glVertex2f(-width / 2, height / 2);
-    glEnd();
-    glPopMatrix();
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
+void JobWorkerMain(int index) {
+    jobQueueIndex = index;
+    while (!jobQuit.load(std::memory_order_relaxed)) {
+        if (TryRunJob()) continue;
+        std::unique_lock<std::mutex> lock(jobSleepMutex);
+        jobWake.wait(lock, [] { return jobQuit.load() || jobsQueued.load() > 0; });
+    }
 }
 
-void RenderPlayer() {
-    float alpha = player.isInvisible ? 0.3f : 1.0f;
-    RenderTexture(ufoTexture, player.position.x, player.position.y, player.width, player.height, alpha, player.direction < 0);
-    if (player.isInvisible) {
-        float pulse = 0.5f + 0.5f * sin(GetTime() / 100.0f);
-        RenderShape(player.position.x, player.position.y, player.width / 2 + 10, player.width / 2 + 10, 0.3f, 0.8f, 1.0f, 0.2f * pulse, true);
+void StartJobSystem() {
+    if (jobThreads <= 0) jobThreads = std::max(1u, std::thread::hardware_concurrency());
+    jobThreads = std::min(jobThreads, MAX_JOB_THREADS);
+    for (int i = 1; i < jobThreads; ++i) jobWorkers[i] = std::thread(JobWorkerMain, i);
+}
+
+void StopJobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(jobSleepMutex);
+        jobQuit = true;
+    }
+    jobWake.notify_all();
+    for (int i = 1; i < jobThreads; ++i) {
+        if (jobWorkers[i].joinable()) jobWorkers[i].join();
     }
 }
 
-void RenderBubbleEffect(const BubbleEffect& effect) {
-    float pulse = 0.5f + 0.5f * sin(GetTime() / 100.0f);
-    float radius = effect.radius * (1.0f + pulse * 0.2f * (1.0f - effect.alpha));
-    if (effect.type == BUBBLE_EFFECT_BOUNCE) {
-        RenderShape(effect.position.x, effect.position.y, radius, radius, 0.7f, 0.8f, 1.0f, effect.alpha * 0.6f, true);
+int JobChunks(int count, int grain) { return (count + grain - 1) / grain; }
+
+// Queues fn(begin, end, chunk) over [0, count) in chunks of grain and returns at once; the phase
+// is complete when pending drops to zero (see WaitForJobs). fn must outlive the phase.
+template <typename Fn>
+void SubmitParallelFor(std::atomic<int>& pending, int count, int grain, Fn& fn) {
+    int chunks = JobChunks(count, grain);
+    if (chunks <= 1 || jobThreads <= 1) {
+        for (int chunk = 0; chunk < chunks; ++chunk) fn(chunk * grain, std::min(count, (chunk + 1) * grain), chunk);
+        return;
     }
-    else if (effect.type == BUBBLE_EFFECT_POP) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glColor4f(0.9f, 0.95f, 1.0f, effect.alpha * 0.8f);
-        glLineWidth(3.0f);
-        glBegin(GL_LINE_LOOP);
-        for (int i = 0; i <= 360; i += 20) {
-            float angle = i * M_PI / 180;
-            glVertex2f(effect.position.x + cos(angle) * radius, effect.position.y + sin(angle) * radius);
+    auto run = [](void* context, int begin, int end, int chunk) { (*static_cast<Fn*>(context))(begin, end, chunk); };
+    int queued = 0;
+    pending.fetch_add(chunks, std::memory_order_relaxed);
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        Job job = { run, const_cast<void*>(static_cast<const void*>(&fn)), chunk * grain, std::min(count, (chunk + 1) * grain), chunk, &pending };
+        JobQueue& queue = jobQueues[chunk % jobThreads];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tail - queue.head < MAX_QUEUED_JOBS) {
+                queue.jobs[queue.tail++ % MAX_QUEUED_JOBS] = job;
+                ++queued;
+                continue;
+            }
         }
-        glEnd();
-        glLineWidth(1.0f);
-        glDisable(GL_BLEND);
+        // Queue full: the submitter runs the chunk itself.
+        fn(job.begin, job.end, chunk);
+        pending.fetch_sub(1, std::memory_order_release);
     }
-    else {
-        for (int i = 0; i < 5; i++) {
-            float offsetX = cos(i * 72 * M_PI / 180) * radius * 0.5f;
-            float offsetY = sin(i * 72 * M_PI / 180) * radius * 0.5f;
-            float smallRadius = radius * (0.3f + 0.1f * sin(GetTime() / 100.0f + i));
-            RenderShape(effect.position.x + offsetX, effect.position.y + offsetY, smallRadius, smallRadius, 0.8f, 0.9f, 1.0f, effect.alpha * 0.7f, true);
-        }
+    {
+        std::lock_guard<std::mutex> lock(jobSleepMutex);
+        jobsQueued.fetch_add(queued, std::memory_order_release);
     }
+    jobWake.notify_all();
 }
 
-void RenderBubbleTrail(const Ball& ball) {
-    float speed = sqrt(ball.velocity.x * ball.velocity.x + ball.velocity.y * ball.velocity.y);
-    int numBubbles = static_cast<int>(speed / 3.0f);
-    for (int i = 0; i < numBubbles; i++) {
-        float t = static_cast<float>(i) / numBubbles;
-        float offsetX = ball.velocity.x * t * -0.2f;
-        float offsetY = ball.velocity.y * t * -0.2f;
-        float size = ball.radius * (0.1f + 0.05f * sin(GetTime() / 100.0f + i * 10.0f));
-        RenderShape(ball.position.x + offsetX, ball.position.y + offsetY, size, size, 0.8f, 0.9f, 1.0f, 0.3f * (1.0f - t), true);
+// The calling thread helps with queued jobs until the phase it depends on has finished.
+void WaitForJobs(std::atomic<int>& pending) {
+    while (pending.load(std::memory_order_acquire) > 0) {
+        if (!TryRunJob()) std::this_thread::yield();
     }
 }
 
-void UpdateBubbleEffects() {
-    int now = GetTime();
-    for (size_t i = 0; i < bubbleEffects.size();) {
-        float elapsed = now - bubbleEffects[i].startTime;
-        if (elapsed > 500.0f) {
-            bubbleEffects.erase(bubbleEffects.begin() + i);
-        }
-        else {
-            bubbleEffects[i].alpha = 1.0f - (elapsed / 500.0f);
-            ++i;
-        }
+template <typename Fn>
+void ParallelFor(int count, int grain, const Fn& fn) {
+    std::atomic<int> pending(0);
+    SubmitParallelFor(pending, count, grain, fn);
+    WaitForJobs(pending);
+}
+
+void ArenaReset() {
+    if (!frameArena.overflow.empty() || frameArena.buffer.empty()) {
+        frameArena.overflow.clear();
+        frameArena.buffer.assign(std::max(FRAME_ARENA_SIZE, frameArena.peak * 2), 0);
+    }
+    frameArena.used = 0;
+}
+
+template <typename T>
+T* ArenaAlloc(size_t count) {
+    size_t offset = (frameArena.used + alignof(T) - 1) & ~(alignof(T) - 1);
+    size_t bytes = count * sizeof(T);
+    frameArena.used = offset + bytes;
+    frameArena.peak = std::max(frameArena.peak, frameArena.used);
+    if (frameArena.used <= frameArena.buffer.size()) return reinterpret_cast<T*>(frameArena.buffer.data() + offset);
+    frameArena.overflow.emplace_back(bytes);
+    return reinterpret_cast<T*>(frameArena.overflow.back().data());
+}
+
+template <typename... C> unsigned ComponentMask() { return (0u | ... | (1u << C::ID)); }
+
+// Archetypes are never removed and the list is reserved up front, so references stay valid while
+// new ones are added.
+Archetype& ArchetypeFor(World& world, unsigned mask) {
+    for (auto& archetype : world.archetypes) {
+        if (archetype.mask == mask) return archetype;
+    }
+    world.archetypes.emplace_back();
+    Archetype& archetype = world.archetypes.back();
+    archetype.mask = mask;
+    archetype.count = 0;
+    size_t rowBytes = 0;
+    for (int c = 0; c < COMPONENT_COUNT; ++c) {
+        if (mask & 1u << c) rowBytes += COMPONENT_SIZES[c];
+    }
+    // Each array starts 16-byte aligned; the slack for that comes off the capacity.
+    archetype.capacity = static_cast<int>((ENTITY_CHUNK_BYTES - 16 * COMPONENT_COUNT) / rowBytes);
+    size_t offset = 0;
+    for (int c = 0; c < COMPONENT_COUNT; ++c) {
+        archetype.offsets[c] = offset;
+        if (mask & 1u << c) offset = (offset + archetype.capacity * COMPONENT_SIZES[c] + 15) & ~static_cast<size_t>(15);
+    }
+    return archetype;
+}
+
+template <typename C> C* ChunkComponents(Archetype& archetype, int chunk) {
+    return reinterpret_cast<C*>(archetype.chunks[chunk].data + archetype.offsets[C::ID]);
+}
+
+template <typename C> const C* ChunkComponents(const Archetype& archetype, int chunk) {
+    return reinterpret_cast<const C*>(archetype.chunks[chunk].data + archetype.offsets[C::ID]);
+}
+
+template <typename C> C& RowComponent(Archetype& archetype, int row) {
+    return ChunkComponents<C>(archetype, row / archetype.capacity)[row % archetype.capacity];
+}
+
+// Appends an entity made of the given components, creating its archetype on first use.
+template <typename... C> void SpawnEntity(World& world, const C&... components) {
+    Archetype& archetype = ArchetypeFor(world, ComponentMask<C...>());
+    int row = archetype.count++;
+    if (row / archetype.capacity >= static_cast<int>(archetype.chunks.size())) archetype.chunks.emplace_back();
+    ((RowComponent<C>(archetype, row) = components), ...);
+}
+
+template <typename... C> void ReserveEntities(World& world, size_t count) {
+    Archetype& archetype = ArchetypeFor(world, ComponentMask<C...>());
+    archetype.chunks.reserve((count + archetype.capacity - 1) / archetype.capacity);
+}
+
+// Copies only the chunks holding live rows; the sweep leaves emptied chunks allocated, so a plain
+// assignment would copy every chunk up to the high-water mark. to keeps its own chunks for reuse.
+void CopyWorld(World& to, const World& from) {
+    to.archetypes.resize(from.archetypes.size());
+    for (size_t a = 0; a < from.archetypes.size(); ++a) {
+        const Archetype& source = from.archetypes[a];
+        Archetype& target = to.archetypes[a];
+        target.mask = source.mask;
+        target.capacity = source.capacity;
+        target.count = source.count;
+        std::copy(source.offsets, source.offsets + COMPONENT_COUNT, target.offsets);
+        size_t used = (source.count + source.capacity - 1) / source.capacity;
+        if (target.chunks.size() < used) target.chunks.resize(used);
+        std::copy(source.chunks.begin(), source.chunks.begin() + used, target.chunks.begin());
+    }
+}
+
+// Calls fn(count, C*...) for each chunk of every archetype that has all of C. Spawning into an
+// archetype while iterating it is not allowed.
+template <typename... C, typename W, typename F> void ForEachChunk(W& world, F fn) {
+    unsigned mask = ComponentMask<C...>();
+    for (auto& archetype : world.archetypes) {
+        if ((archetype.mask & mask) != mask) continue;
+        for (int chunk = 0; chunk * archetype.capacity < archetype.count; ++chunk) {
+            fn(std::min(archetype.capacity, archetype.count - chunk * archetype.capacity), ChunkComponents<C>(archetype, chunk)...);
+        }
+    }
+}
+
+template <typename... C, typename W, typename F> void ForEachEntity(W& world, F fn) {
+    ForEachChunk<C...>(world, [&fn](int count, auto*... components) {
+        for (int i = 0; i < count; ++i) fn(components[i]...);
+    });
+}
+
+template <typename... C> size_t EntityCount(const World& world) {
+    unsigned mask = ComponentMask<C...>();
+    size_t count = 0;
+    for (const auto& archetype : world.archetypes) {
+        if ((archetype.mask & mask) == mask) count += archetype.count;
+    }
+    return count;
+}
+
+void ClearEntities(World& world) {
+    for (auto& archetype : world.archetypes) archetype.count = 0;
+}
+
+// Moves count rows from row from down to row to (to <= from), one memmove per component array for
+// each stretch that stays inside a chunk on both sides.
+void MoveEntityRows(Archetype& archetype, int from, int to, int count) {
+    while (count > 0) {
+        int fromChunk = from / archetype.capacity, fromRow = from % archetype.capacity;
+        int toChunk = to / archetype.capacity, toRow = to % archetype.capacity;
+        int n = std::min(count, archetype.capacity - std::max(fromRow, toRow));
+        for (int c = 0; c < COMPONENT_COUNT; ++c) {
+            if (!(archetype.mask & 1u << c)) continue;
+            size_t size = COMPONENT_SIZES[c];
+            memmove(archetype.chunks[toChunk].data + archetype.offsets[c] + toRow * size,
+                archetype.chunks[fromChunk].data + archetype.offsets[c] + fromRow * size, n * size);
+        }
+        from += n;
+        to += n;
+        count -= n;
+    }
+}
+
+// Removes every entity whose lifetime is over, keeping the rest in order. Surviving runs are moved
+// as blocks, so the usual sweep (a prefix of the oldest rows expired) is a few memmoves per chunk.
+void SweepExpired(World& world) {
+    int now = GetTime();
+    for (auto& archetype : world.archetypes) {
+        if (!(archetype.mask & ComponentMask<Lifetime>())) continue;
+        int kept = 0, runStart = -1, row = 0;
+        for (int chunk = 0; chunk * archetype.capacity < archetype.count; ++chunk) {
+            const Lifetime* lifetimes = ChunkComponents<Lifetime>(archetype, chunk);
+            int count = std::min(archetype.capacity, archetype.count - chunk * archetype.capacity);
+            for (int i = 0; i < count; ++i, ++row) {
+                bool expired = lifetimes[i].durationMs >= 0 && now - lifetimes[i].startTime > lifetimes[i].durationMs;
+                if (!expired) {
+                    if (runStart < 0) runStart = row;
+                    continue;
+                }
+                if (runStart < 0) continue;
+                if (kept != runStart) MoveEntityRows(archetype, runStart, kept, row - runStart);
+                kept += row - runStart;
+                runStart = -1;
+            }
+        }
+        if (runStart >= 0) {
+            if (kept != runStart) MoveEntityRows(archetype, runStart, kept, row - runStart);
+            kept += row - runStart;
+        }
+        archetype.count = kept;
+    }
+}
+
+// Every meteor lives in this one archetype, so its rows can stand in for meteor indices.
+Archetype& MeteorArchetype() { return ArchetypeFor(world, ComponentMask<Position, MeteorState, Lifetime>()); }
+
+// Persistent containers are sized up front so normal play never grows them mid-tick.
+void ReservePools() {
+    size_t ballCount = BALL_POOL_SIZE, meteorCount = METEOR_POOL_SIZE, effectCount = EFFECT_POOL_SIZE;
+    if (swarmMode) {
+        ballCount = std::max(ballCount, static_cast<size_t>(swarmBalls) * 2);
+        meteorCount = std::max(meteorCount, static_cast<size_t>(swarmMeteors) * 2);
+        effectCount = std::max(effectCount, static_cast<size_t>(swarmEffects + swarmBalls) * 2);
+    }
+    balls.reserve(ballCount);
+    ballPaths.reserve(ballCount);
+    hotBalls.reserve(ballCount);
+    ballGrid.ranges.reserve(ballCount);
+    ballGrid.cellStart.reserve(GRID_COLUMNS * GRID_ROWS + 1);
+    ballGrid.items.reserve(ballCount * GRID_BALL_CELLS);
+    ballGrid.current.reserve(ballCount);
+    ballGrid.origin.reserve(ballCount);
+    ballGrid.added.reserve(ballCount);
+    meteorGrid.ranges.reserve(meteorCount);
+    meteorGrid.cellStart.reserve(GRID_COLUMNS * GRID_ROWS + 1);
+    meteorGrid.items.reserve(meteorCount * GRID_BALL_CELLS);
+    world.archetypes.reserve(MAX_ARCHETYPES);
+    ReserveEntities<Position, MeteorState, Lifetime>(world, meteorCount);
+    ReserveEntities<Position, EffectShape, Lifetime>(world, effectCount);
+    particleBursts.reserve(BURST_POOL_SIZE);
+    std::vector<BallEvent> eventStorage;
+    eventStorage.reserve(ballCount * 2);
+    ballEvents = std::priority_queue<BallEvent, std::vector<BallEvent>, BallEventLater>(BallEventLater(), std::move(eventStorage));
+    ballChunkEffects.resize(JobChunks(static_cast<int>(ballCount), BALL_JOB_GRAIN));
+    for (auto& chunk : ballChunkEffects) chunk.reserve(EFFECT_POOL_SIZE / 4);
+    ArenaReset();
+}
+
+long long SimTick() { return simTime / SIM_TICK_MS; }
+
+int TimerSlot(long long due) {
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && ((due ^ timerWheel.now) >> (TIMER_WHEEL_BITS * (level + 1))) != 0) ++level;
+    return level * TIMER_WHEEL_SLOTS + static_cast<int>((due >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+}
+
+void LinkTimer(int index) {
+    TimerNode& node = timerWheel.nodes[index];
+    node.slot = TimerSlot(node.due);
+    node.next = -1;
+    node.prev = timerWheel.tail[node.slot];
+    if (node.prev >= 0) timerWheel.nodes[node.prev].next = index;
+    else timerWheel.head[node.slot] = index;
+    timerWheel.tail[node.slot] = index;
+}
+
+void UnlinkTimer(int index) {
+    const TimerNode& node = timerWheel.nodes[index];
+    if (node.prev >= 0) timerWheel.nodes[node.prev].next = node.next;
+    else timerWheel.head[node.slot] = node.next;
+    if (node.next >= 0) timerWheel.nodes[node.next].prev = node.prev;
+    else timerWheel.tail[node.slot] = node.prev;
+}
+
+void ResetTimers(long long now) {
+    std::fill(timerWheel.head, timerWheel.head + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, -1);
+    std::fill(timerWheel.tail, timerWheel.tail + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, -1);
+    for (int i = 0; i < MAX_TIMERS; ++i) timerWheel.nodes[i].next = i + 1 < MAX_TIMERS ? i + 1 : -1;
+    timerWheel.freeList = 0;
+    timerWheel.now = now;
+    scoreTimer = meteorDropTimer = invisibilityTimer = -1;
+}
+
+// Fires at the first step that reaches tick due (the next tick if due has passed). Returns the
+// handle, or -1 when the pool is exhausted.
+int ScheduleTimer(long long due, int type) {
+    int index = timerWheel.freeList;
+    if (index < 0) return -1;
+    timerWheel.freeList = timerWheel.nodes[index].next;
+    timerWheel.nodes[index].due = std::max(due, timerWheel.now + 1);
+    timerWheel.nodes[index].type = type;
+    LinkTimer(index);
+    return index;
+}
+
+void CancelTimer(int& handle) {
+    if (handle < 0) return;
+    UnlinkTimer(handle);
+    timerWheel.nodes[handle].next = timerWheel.freeList;
+    timerWheel.freeList = handle;
+    handle = -1;
+}
+
+// Sweeps remove everything expired when they run, so one per due tick is enough, and one lost to a
+// full pool only delays removal to the next sweep.
+void ScheduleSweep(long long due, int type) {
+    due = std::max(due, timerWheel.now + 1);
+    for (int index = timerWheel.head[TimerSlot(due)]; index >= 0; index = timerWheel.nodes[index].next) {
+        if (timerWheel.nodes[index].due == due && timerWheel.nodes[index].type == type) return;
+    }
+    ScheduleTimer(due, type);
+}
+
+// Advances the wheel to tick, one tick at a time so fast-forward steps fire exactly what per-tick
+// steps would, and returns the TIMER_* types that fired as a bit mask.
+int AdvanceTimers(long long tick) {
+    int fired = 0;
+    while (timerWheel.now < tick) {
+        long long now = ++timerWheel.now;
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+            if ((now & ((1LL << (TIMER_WHEEL_BITS * level)) - 1)) != 0) continue;
+            int slot = level * TIMER_WHEEL_SLOTS + static_cast<int>((now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+            int index = timerWheel.head[slot];
+            timerWheel.head[slot] = timerWheel.tail[slot] = -1;
+            while (index >= 0) {
+                int next = timerWheel.nodes[index].next;
+                LinkTimer(index);
+                index = next;
+            }
+        }
+        int slot = static_cast<int>(now & (TIMER_WHEEL_SLOTS - 1));
+        while (timerWheel.head[slot] >= 0) {
+            int index = timerWheel.head[slot];
+            int* handle = TIMER_HANDLES[timerWheel.nodes[index].type];
+            fired |= 1 << timerWheel.nodes[index].type;
+            timerFiredTick[timerWheel.nodes[index].type] = now;
+            if (handle && *handle == index) CancelTimer(*handle);
+            else CancelTimer(index);
+        }
+    }
+    return fired;
+}
+
+// Starts a lifetime and schedules the sweep that removes the entity at the first tick past it.
+void StartLifetime(Lifetime& lifetime, int startTime, int durationMs) {
+    lifetime = { startTime, durationMs };
+    if (durationMs >= 0) ScheduleSweep((startTime + durationMs) / SIM_TICK_MS + 1, TIMER_EXPIRY_SWEEP);
+}
+
+void SpawnEffect(const BubbleEffect& effect) {
+    Lifetime lifetime;
+    StartLifetime(lifetime, effect.startTime, EFFECT_LIFETIME_MS);
+    SpawnEntity(world, Position{ effect.position }, EffectShape{ effect.radius, effect.type }, lifetime);
+}
+
+void SpawnMeteor(Vector2 position) {
+    SpawnEntity(world, Position{ position }, MeteorState{ false }, Lifetime{ 0, -1 });
+}
+
+// Event-driven physics: a "cold" ball is above the band where it could reach the player, so its
+// motion is pure ballistics between floor/wall contacts. Its state is kept at ball.time and only
+// advanced when one of its scheduled events fires or its position is queried. "Hot" balls near the
+// player are stepped every tick so they can be collision-checked.
+float BandY(const Ball& ball) { return player.position.y - player.width / 2 - ball.radius; }
+
+void SyncBall(Ball& ball, double t) {
+    float dt = static_cast<float>(t - ball.time);
+    ball.position = { ball.position.x + ball.velocity.x * dt, ball.position.y + ball.velocity.y * dt + 0.5f * GRAVITY * dt * dt };
+    ball.velocity.y += GRAVITY * dt;
+    ball.time = t;
+}
+
+bool SolveQuadratic(float a, float b, float c, float& r1, float& r2);
+
+void ScheduleBall(int index) {
+    Ball& ball = balls[index];
+    ball.generation = nextBallGeneration++;
+    BallEvent event = { 0.0, index, ball.generation, BALL_EVENT_FLOOR };
+    float hitTime = 0.0f, r1, r2;
+    if (SolveQuadratic(0.5f * GRAVITY, ball.velocity.y, std::min(ball.position.y + ball.radius - FLOOR_Y, 0.0f), r1, r2)) hitTime = std::max(r2, 0.0f);
+    if (ball.velocity.x < 0) {
+        float wallTime = std::max(0.0f, (ball.radius - ball.position.x) / ball.velocity.x);
+        if (wallTime < hitTime) { hitTime = wallTime; event.type = BALL_EVENT_LEFT_WALL; }
+    }
+    else if (ball.velocity.x > 0) {
+        float wallTime = std::max(0.0f, (SCREEN_WIDTH - ball.radius - ball.position.x) / ball.velocity.x);
+        if (wallTime < hitTime) { hitTime = wallTime; event.type = BALL_EVENT_RIGHT_WALL; }
+    }
+    if (SolveQuadratic(0.5f * GRAVITY, ball.velocity.y, ball.position.y - BandY(ball), r1, r2) && r2 >= 0 && r2 < hitTime) {
+        hitTime = r2;
+        event.type = BALL_EVENT_ENTER_BAND;
+    }
+    event.time = ball.time + hitTime;
+    ballEvents.push(event);
+}
+
+void MakeBallHot(int index) {
+    Ball& ball = balls[index];
+    if (ball.hotSlot >= 0) return;
+    ball.generation = nextBallGeneration++;
+    ball.hotSlot = static_cast<int>(hotBalls.size());
+    hotBalls.push_back(index);
+}
+
+void RemoveHotBall(int index) {
+    int slot = balls[index].hotSlot;
+    if (slot < 0) return;
+    hotBalls[slot] = hotBalls.back();
+    balls[hotBalls[slot]].hotSlot = slot;
+    hotBalls.pop_back();
+    balls[index].hotSlot = -1;
+}
+
+void ClassifyBall(int index) {
+    if (balls[index].position.y >= BandY(balls[index])) {
+        MakeBallHot(index);
+    }
+    else {
+        RemoveHotBall(index);
+        ScheduleBall(index);
+    }
+}
+
+void AdvanceBall(Ball& ball, float startTime, float dt, BallPath& path, bool emitEffects = true);
+
+void ProcessBallEvents(double stepStart, double now) {
+    while (!ballEvents.empty() && ballEvents.top().time <= now) {
+        BallEvent event = ballEvents.top();
+        ballEvents.pop();
+        if (event.index >= static_cast<int>(balls.size()) || balls[event.index].generation != event.generation) continue;
+        ++ballEventsProcessed;
+        Ball& ball = balls[event.index];
+        SyncBall(ball, event.time);
+        int effectTime = static_cast<int>(event.time * SIM_TICK_MS);
+        if (event.type == BALL_EVENT_ENTER_BAND) {
+            // Finish the step as a hot ball so it has a path to collision-check against the player.
+            AdvanceBall(ball, static_cast<float>(event.time - stepStart), static_cast<float>(now - event.time), ballPaths[event.index]);
+            ball.time = now;
+            MakeBallHot(event.index);
+            continue;
+        }
+        BubbleEffect effect = { ball.position, ball.radius * 0.5f, BUBBLE_EFFECT_BOUNCE, effectTime };
+        if (event.type == BALL_EVENT_FLOOR) {
+            ball.position.y = FLOOR_Y - ball.radius;
+            ball.velocity.y = -fabs(ball.velocity.y) * BALL_BOUNCE_FACTOR;
+            effect.position = ball.position;
+            effect.radius = ball.radius * 0.8f;
+        }
+        else if (event.type == BALL_EVENT_LEFT_WALL) {
+            ball.position.x = ball.radius;
+            ball.velocity.x = fabs(ball.velocity.x);
+            effect.position.x = 0;
+        }
+        else {
+            ball.position.x = SCREEN_WIDTH - ball.radius;
+            ball.velocity.x = -fabs(ball.velocity.x);
+            effect.position.x = SCREEN_WIDTH;
+        }
+        SpawnEffect(effect);
+        ScheduleBall(event.index);
+    }
+}
+
+void SyncAllBalls() {
+    double now = SimTicks();
+    for (auto& ball : balls) {
+        if (ball.hotSlot < 0) SyncBall(ball, now);
+    }
+}
+
+void AddBall(const Ball& ball) {
+    balls.push_back(ball);
+    if (!eventPhysics) return;
+    Ball& added = balls.back();
+    added.time = SimTicks();
+    added.hotSlot = -1;
+    ClassifyBall(static_cast<int>(balls.size()) - 1);
+}
+
+// Swap-and-pop; the last ball takes over the removed ball's slot.
+void RemoveBall(int index) {
+    int last = static_cast<int>(balls.size()) - 1;
+    if (eventPhysics) RemoveHotBall(index);
+    if (index != last) {
+        balls[index] = balls[last];
+        if (eventPhysics) {
+            if (balls[index].hotSlot >= 0) hotBalls[balls[index].hotSlot] = index;
+            else ScheduleBall(index);
+        }
+    }
+    balls.pop_back();
+}
+
+void ClearBalls() {
+    balls.clear();
+    hotBalls.clear();
+    while (!ballEvents.empty()) ballEvents.pop();
+}
+
+// Particles are purely cosmetic: bursts are queued by the simulation and spawned by the renderer,
+// with their own random stream so they never perturb gameplay randomness.
+float ParticleRandom() {
+    particleRandomState ^= particleRandomState << 13;
+    particleRandomState ^= particleRandomState >> 17;
+    particleRandomState ^= particleRandomState << 5;
+    return (particleRandomState >> 8) * (1.0f / 16777216.0f);
+}
+
+void InitParticles() {
+    for (auto* channel : { &particles.x, &particles.y, &particles.vx, &particles.vy, &particles.life, &particles.decay, &particles.r, &particles.g, &particles.b }) {
+        channel->assign(MAX_PARTICLES, 0.0f);
+    }
+    particles.vertices.assign(MAX_PARTICLES * 2, 0.0f);
+    particles.colors.assign(MAX_PARTICLES * 4, 0.0f);
+    particles.count = 0;
+}
+
+void EmitParticles(Vector2 position, float radius, float speed, int count, float r, float g, float b) {
+    if (headless) return;
+    ParticleBurst burst = { position, radius, speed, count, { r, g, b } };
+    particleBursts.push_back(burst);
+}
+
+void SpawnParticleBurst(const ParticleBurst& burst) {
+    int count = std::min(burst.count, MAX_PARTICLES - particles.count);
+    for (int n = 0; n < count; ++n) {
+        int i = particles.count++;
+        float angle = ParticleRandom() * 2.0f * static_cast<float>(M_PI);
+        float dirX = cos(angle), dirY = sin(angle);
+        float offset = burst.radius * ParticleRandom();
+        float speed = burst.speed * (0.2f + 0.8f * ParticleRandom());
+        float shade = 0.8f + 0.2f * ParticleRandom();
+        particles.x[i] = burst.position.x + dirX * offset;
+        particles.y[i] = burst.position.y + dirY * offset;
+        particles.vx[i] = dirX * speed;
+        particles.vy[i] = dirY * speed - 1.0f;
+        particles.life[i] = 1.0f;
+        particles.decay[i] = 1.0f / (30.0f + 40.0f * ParticleRandom());
+        particles.r[i] = burst.color[0] * shade;
+        particles.g[i] = burst.color[1] * shade;
+        particles.b[i] = burst.color[2] * shade;
+    }
+}
+
+// The kernels take restrict-qualified arrays as parameters so the compiler can vectorize them.
+void IntegrateParticles(int n, float dt, float drag, float gravity, float* __restrict x, float* __restrict y,
+    float* __restrict vx, float* __restrict vy, float* __restrict life, const float* __restrict decay) {
+    for (int i = 0; i < n; ++i) {
+        vy[i] += gravity;
+        vx[i] *= drag;
+        vy[i] *= drag;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        life[i] -= decay[i] * dt;
+    }
+}
+
+void BuildParticleVertices(int n, const float* __restrict x, const float* __restrict y, const float* __restrict r, const float* __restrict g,
+    const float* __restrict b, const float* __restrict life, float* __restrict vertices, float* __restrict colors) {
+    for (int i = 0; i < n; ++i) {
+        vertices[2 * i] = x[i];
+        vertices[2 * i + 1] = y[i];
+        colors[4 * i] = r[i];
+        colors[4 * i + 1] = g[i];
+        colors[4 * i + 2] = b[i];
+        colors[4 * i + 3] = life[i];
+    }
+}
+
+void UpdateParticles(float dt) {
+    int n = particles.count;
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* vx = particles.vx.data();
+    float* vy = particles.vy.data();
+    float* life = particles.life.data();
+    float* decay = particles.decay.data();
+    IntegrateParticles(n, dt, static_cast<float>(pow(PARTICLE_DRAG, dt)), PARTICLE_GRAVITY * dt, x, y, vx, vy, life, decay);
+
+    int alive = 0;
+    for (int i = 0; i < n; ++i) {
+        if (life[i] <= 0.0f) continue;
+        if (alive != i) {
+            x[alive] = x[i]; y[alive] = y[i]; vx[alive] = vx[i]; vy[alive] = vy[i];
+            life[alive] = life[i]; decay[alive] = decay[i];
+            particles.r[alive] = particles.r[i]; particles.g[alive] = particles.g[i]; particles.b[alive] = particles.b[i];
+        }
+        ++alive;
+    }
+    particles.count = alive;
+}
+
+void SpawnBall(float x, float y, float radius) {
+    Ball ball;
+    ball.position = { x, y };
+    ball.radius = radius;
+    if (fixedPoint) {
+        // The same draws in fixed point: speed in [1, 1.3) times 2 + radius / 15 pixels a tick.
+        Fixed speed = FIXED_ONE + GameRandom() % (FIXED_ONE * 3 / 10);
+        Fixed direction = GameRandom() % 2 ? 1 : -1;
+        ball.fixedPosition = ToFixed(ball.position);
+        ball.fixedVelocity = { direction * FixedMul(2 * FIXED_ONE + ToFixed(radius) / 15, speed), -FIXED_ONE * 3 / 2 };
+        ball.velocity = FromFixed(ball.fixedVelocity);
+    }
+    else {
+        float speed = 1.0f + static_cast<float>(rand()) / RAND_MAX * 0.3f;
+        float direction = (rand() % 2 ? 1.0f : -1.0f);
+        ball.velocity = { direction * (2.0f + radius / 15.0f) * speed, -1.5f };
+    }
+    ball.points = static_cast<int>(100.0f / (radius / 10.0f));
+    ball.time = SimTicks();
+    ball.generation = 0;
+    ball.hotSlot = -1;
+    ball.trailHead = 0;
+    ball.trailCount = 0;
+    AddBall(ball);
+    EmitTelemetry(TELEMETRY_BALL_SPAWN, 0, x, y, radius);
+}
+
+void SpawnRandomBall() {
+    float x = 100.0f + static_cast<float>(GameRandom() % (SCREEN_WIDTH - 200));
+    float radius = 20.0f + static_cast<float>(GameRandom() % 41);
+    SpawnBall(x, 100, radius);
+    lastBallSpawnScore = score;
+}
+
+template <typename Mode>
+void CheckBallSpawn() {
+    const int interval = Mode::spawnScoreInterval;
+    int spawnIntervals = score / interval;
+    int lastSpawnIntervals = lastBallSpawnScore / interval;
+    if (spawnIntervals > lastSpawnIntervals || (balls.empty() && score > lastBallSpawnScore)) {
+        SpawnRandomBall();
+    }
+}
+
+template <typename Mode>
+void SplitBall(int index) {
+    BubbleEffect effect = { balls[index].position, balls[index].radius, BUBBLE_EFFECT_SPLIT, GetTime() };
+    SpawnEffect(effect);
+    score += balls[index].points;
+    EmitTelemetry(TELEMETRY_BALL_SPLIT, balls[index].radius > 20, balls[index].position.x, balls[index].position.y, balls[index].radius);
+    QueueSound(balls[index].radius > 20 ? SOUND_SPLIT : SOUND_POP, balls[index].position.x);
+    EmitParticles(balls[index].position, balls[index].radius, 4.0f, static_cast<int>(SPLIT_PARTICLES * balls[index].radius / 30.0f), 0.7f, 1.0f, 0.7f);
+
+    if (balls[index].radius > 20) {
+        float newRadius = balls[index].radius / 2;
+        Ball newBall1 = balls[index];
+        newBall1.radius = newRadius;
+        newBall1.velocity = { balls[index].velocity.x + 1.5f, -balls[index].velocity.y };
+        newBall1.points = balls[index].points * 2;
+        Ball newBall2 = balls[index];
+        newBall2.radius = newRadius;
+        newBall2.velocity = { -balls[index].velocity.x - 1.5f, -balls[index].velocity.y };
+        newBall2.points = balls[index].points * 2;
+        if (fixedPoint) {
+            FixedVector velocity = balls[index].fixedVelocity;
+            newBall1.fixedVelocity = { velocity.x + FIXED_ONE * 3 / 2, -velocity.y };
+            newBall2.fixedVelocity = { -velocity.x - FIXED_ONE * 3 / 2, -velocity.y };
+            newBall1.velocity = FromFixed(newBall1.fixedVelocity);
+            newBall2.velocity = FromFixed(newBall2.fixedVelocity);
+        }
+        AddBall(newBall1);
+        AddBall(newBall2);
+    }
+
+    RemoveBall(index);
+    CheckBallSpawn<Mode>();
+}
+
+Vector2 SegmentPosition(const BallSegment& segment, float t) {
+    float dt = t - segment.startTime;
+    return { segment.position.x + segment.velocity.x * dt, segment.position.y + segment.velocity.y * dt + 0.5f * GRAVITY * dt * dt };
+}
+
+Vector2 SegmentVelocity(const BallSegment& segment, float t) {
+    return { segment.velocity.x, segment.velocity.y + GRAVITY * (t - segment.startTime) };
+}
+
+const BallSegment& PathSegmentAt(const BallPath& path, float t) {
+    int i = 0;
+    while (i + 1 < path.count && t >= path.segments[i].endTime) ++i;
+    return path.segments[i];
+}
+
+// Roots of a*x^2 + b*x + c in ascending order; returns false if there are none.
+bool SolveQuadratic(float a, float b, float c, float& r1, float& r2) {
+    if (fabs(a) < 1e-8f) {
+        if (fabs(b) < 1e-8f) return false;
+        r1 = r2 = -c / b;
+        return true;
+    }
+    float disc = b * b - 4.0f * a * c;
+    if (disc < 0) return false;
+    float root = sqrt(disc);
+    float q = -0.5f * (b + (b < 0 ? -root : root));
+    r1 = q / a;
+    r2 = fabs(q) > 1e-8f ? c / q : r1;
+    if (r1 > r2) std::swap(r1, r2);
+    return true;
+}
+
+void PushBounceEffect(float x, float y, float radius, float t, bool emitEffects) {
+    if (!emitEffects) return;
+    BubbleEffect effect = { {x, y}, radius, BUBBLE_EFFECT_BOUNCE, StepTime(t) };
+    if (effectSink) effectSink->push_back(effect);
+    else SpawnEffect(effect);
+}
+
+// Moves a ball dt ticks along its exact ballistic path, reflecting off the floor and walls at the
+// moment of contact and recording each piece of the path so collisions can be solved in time.
+void AdvanceBall(Ball& ball, float startTime, float dt, BallPath& path, bool emitEffects) {
+    float t = startTime, endTime = startTime + dt;
+    path.count = 0;
+    while (path.count < MAX_BALL_SEGMENTS) {
+        BallSegment& segment = path.segments[path.count++];
+        segment = { t, endTime, ball.position, ball.velocity };
+        float hitTime = endTime, r1, r2;
+        int wall = 0;
+        float floorGap = ball.position.y + ball.radius - FLOOR_Y;
+        if (floorGap >= 0 && ball.velocity.y > 0) {
+            hitTime = t;
+            wall = 1;
+        }
+        else if (SolveQuadratic(0.5f * GRAVITY, ball.velocity.y, std::min(floorGap, 0.0f), r1, r2) && r2 >= 0 && t + r2 < hitTime) {
+            hitTime = t + r2;
+            wall = 1;
+        }
+        if (ball.velocity.x < 0) {
+            float wallTime = t + std::max(0.0f, (ball.radius - ball.position.x) / ball.velocity.x);
+            if (wallTime < hitTime) { hitTime = wallTime; wall = 2; }
+        }
+        else if (ball.velocity.x > 0) {
+            float wallTime = t + std::max(0.0f, (SCREEN_WIDTH - ball.radius - ball.position.x) / ball.velocity.x);
+            if (wallTime < hitTime) { hitTime = wallTime; wall = 3; }
+        }
+        segment.endTime = hitTime;
+        ball.position = SegmentPosition(segment, hitTime);
+        ball.velocity = SegmentVelocity(segment, hitTime);
+        t = hitTime;
+        if (wall == 0) break;
+        if (wall == 1) {
+            ball.position.y = FLOOR_Y - ball.radius;
+            ball.velocity.y *= -BALL_BOUNCE_FACTOR;
+            PushBounceEffect(ball.position.x, ball.position.y, ball.radius * 0.8f, t, emitEffects);
+        }
+        else if (wall == 2) {
+            ball.position.x = ball.radius;
+            ball.velocity.x *= -1.0f;
+            PushBounceEffect(ball.position.x - ball.radius, ball.position.y, ball.radius * 0.5f, t, emitEffects);
+        }
+        else {
+            ball.position.x = SCREEN_WIDTH - ball.radius;
+            ball.velocity.x *= -1.0f;
+            PushBounceEffect(ball.position.x + ball.radius, ball.position.y, ball.radius * 0.5f, t, emitEffects);
+        }
+    }
+    path.segments[path.count - 1].endTime = endTime;
+}
+
+// Earliest time in [startTime, endTime] at which the beam (tip rising at LASER_SPEED from
+// beam.position.y at time 0, tail at the player) touches the ball, or -1.
+float BeamTimeOfImpact(const BallPath& path, float radius, const Projectile& beam, float endTime) {
+    for (int i = 0; i < path.count; ++i) {
+        const BallSegment& segment = path.segments[i];
+        float lo = segment.startTime, hi = std::min(segment.endTime, endTime);
+        if (segment.velocity.x != 0) {
+            float a = segment.startTime + (beam.startX - radius - segment.position.x) / segment.velocity.x;
+            float b = segment.startTime + (beam.startX + radius - segment.position.x) / segment.velocity.x;
+            lo = std::max(lo, std::min(a, b));
+            hi = std::min(hi, std::max(a, b));
+        }
+        else if (fabs(segment.position.x - beam.startX) > radius) continue;
+        float r1, r2;
+        if (!SolveQuadratic(0.5f * GRAVITY, segment.velocity.y, segment.position.y - player.position.y, r1, r2)) continue;
+        lo = std::max(lo, segment.startTime + r1);
+        hi = std::min(hi, segment.startTime + r2);
+        if (lo > hi) continue;
+        float tipOffset = beam.position.y - LASER_SPEED * segment.startTime;
+        if (!SolveQuadratic(0.5f * GRAVITY, segment.velocity.y + LASER_SPEED, segment.position.y - tipOffset, r1, r2)) return lo;
+        if (lo <= std::min(hi, segment.startTime + r1)) return lo;
+        if (std::max(lo, segment.startTime + r2) <= hi) return std::max(lo, segment.startTime + r2);
+    }
+    return -1.0f;
+}
+
+// Earliest time the ball overlaps the player, found by bracketing the sign change of the squared
+// distance along each path segment and refining it by bisection, or -1.
+float PlayerTimeOfImpact(const BallPath& path, float radius) {
+    float reach = radius + player.width / 2;
+    auto gap = [&](const BallSegment& segment, float t) {
+        Vector2 p = SegmentPosition(segment, t);
+        float dx = p.x - player.position.x, dy = p.y - player.position.y;
+        return dx * dx + dy * dy - reach * reach;
+    };
+    for (int i = 0; i < path.count; ++i) {
+        const BallSegment& segment = path.segments[i];
+        float prev = segment.startTime;
+        if (gap(segment, prev) < 0) return prev;
+        int samples = std::max(1, static_cast<int>(ceil((segment.endTime - segment.startTime) * 4.0f)));
+        for (int k = 1; k <= samples; ++k) {
+            float next = segment.startTime + (segment.endTime - segment.startTime) * k / samples;
+            if (gap(segment, next) < 0) {
+                for (int iter = 0; iter < 20; ++iter) {
+                    float mid = 0.5f * (prev + next);
+                    if (gap(segment, mid) < 0) next = mid; else prev = mid;
+                }
+                return next;
+            }
+            prev = next;
+        }
+    }
+    return -1.0f;
+}
+
+// Earliest time in [fromTime, endTime] at which the bolt enters the ball, or -1. Only entering
+// counts, so a piercing bolt does not re-hit what it is already inside (such as a split's children).
+float BoltTimeOfImpact(const BallPath& path, float radius, const Projectile& bolt, float fromTime, float endTime) {
+    float reach = radius + BOLT_RADIUS;
+    auto gap = [&](const BallSegment& segment, float t) {
+        Vector2 p = SegmentPosition(segment, t);
+        float dx = p.x - bolt.position.x - bolt.velocity.x * t, dy = p.y - bolt.position.y - bolt.velocity.y * t;
+        return dx * dx + dy * dy - reach * reach;
+    };
+    for (int i = 0; i < path.count; ++i) {
+        const BallSegment& segment = path.segments[i];
+        float lo = std::max(segment.startTime, fromTime), hi = std::min(segment.endTime, endTime);
+        if (lo >= hi) continue;
+        float prev = lo;
+        bool outside = gap(segment, prev) >= 0;
+        int samples = std::max(1, static_cast<int>(ceil((hi - lo) * 4.0f)));
+        for (int k = 1; k <= samples; ++k) {
+            float next = lo + (hi - lo) * k / samples;
+            bool inside = gap(segment, next) < 0;
+            if (inside && outside) {
+                for (int iter = 0; iter < 20; ++iter) {
+                    float mid = 0.5f * (prev + next);
+                    if (gap(segment, mid) < 0) next = mid; else prev = mid;
+                }
+                return next;
+            }
+            outside = !inside;
+            prev = next;
+        }
+    }
+    return -1.0f;
+}
+
+// Earliest time in [fromTime, dt] at which the shot reaches a falling meteor, or -1. meteors already
+// hold their end-of-step position here.
+float MeteorTimeOfImpact(Vector2 position, const MeteorState& meteor, const Projectile& shot, float fromTime, float dt) {
+    if (meteor.hasExploded) return -1.0f;
+    float startY = position.y - METEOR_FALL_SPEED * dt;
+    if (shot.isBeam) {
+        if (fabs(position.x - shot.startX) > METEOR_HIT_RADIUS || startY > player.position.y) return -1.0f;
+        float t = std::max(0.0f, (shot.position.y - startY - METEOR_HIT_RADIUS) / (LASER_SPEED + METEOR_FALL_SPEED));
+        return t <= std::min(dt, shot.position.y / LASER_SPEED) ? t : -1.0f;
+    }
+    float dx = shot.position.x - position.x, dy = shot.position.y - startY;
+    float wx = shot.velocity.x, wy = shot.velocity.y - METEOR_FALL_SPEED, reach = METEOR_HIT_RADIUS + BOLT_RADIUS;
+    float r1, r2;
+    if (!SolveQuadratic(wx * wx + wy * wy, 2.0f * (dx * wx + dy * wy), dx * dx + dy * dy - reach * reach, r1, r2)) return -1.0f;
+    if (r2 < fromTime || r1 > dt) return -1.0f;
+    return std::max(r1, fromTime);
+}
+
+float ShotTimeOfImpact(const Projectile& shot, int ballIndex, float fromTime, float dt) {
+    if (shot.isBeam) return BeamTimeOfImpact(ballPaths[ballIndex], balls[ballIndex].radius, shot, std::min(dt, shot.position.y / LASER_SPEED));
+    return BoltTimeOfImpact(ballPaths[ballIndex], balls[ballIndex].radius, shot, fromTime, dt);
+}
+
+bool SpawnProjectile(const Projectile& shot) {
+    if (projectileCount >= MAX_PROJECTILES) return false;
+    projectiles[projectileCount++] = shot;
+    return true;
+}
+
+void FireWeapon() {
+    const Weapon& weapon = WEAPONS[player.weapon];
+    int now = GetTime();
+    if (now - player.lastShootTime < weapon.cooldown) return;
+    if (weapon.beam) {
+        // The classic laser keeps its one-beam-at-a-time rule.
+        for (int i = 0; i < projectileCount; ++i) {
+            if (projectiles[i].isBeam) return;
+        }
+    }
+    player.lastShootTime = now;
+    for (int k = 0; k < weapon.shots; ++k) {
+        float angle = weapon.shots > 1 ? (-0.5f + static_cast<float>(k) / (weapon.shots - 1)) * weapon.spread * static_cast<float>(M_PI) / 180.0f : 0.0f;
+        Projectile shot = { player.position, { weapon.speed * sinf(angle), -weapon.speed * cosf(angle) }, player.position.x, player.weapon, weapon.pierce, true, weapon.beam, {}, {} };
+        if (fixedPoint) {
+            Fixed degrees = weapon.shots > 1 ? static_cast<Fixed>(ToFixed(weapon.spread) * (2LL * k - (weapon.shots - 1)) / (2 * (weapon.shots - 1))) : 0;
+            Fixed sine, cosine, speed = ToFixed(weapon.speed);
+            FixedSinCos(degrees, sine, cosine);
+            shot.fixedPosition = ToFixed(player.position);
+            shot.fixedVelocity = { FixedMul(speed, sine), -FixedMul(speed, cosine) };
+            shot.velocity = FromFixed(shot.fixedVelocity);
+        }
+        SpawnProjectile(shot);
+    }
+    EmitTelemetry(TELEMETRY_SHOT_FIRED, player.weapon, player.position.x, player.position.y, static_cast<float>(weapon.shots));
+    QueueSound(SOUND_LASER, player.position.x, 0.6f);
+}
+
+void ActivateInvisibility() {
+    if (player.remainingInvisibilityUses > 0 && !player.isInvisible) {
+        player.isInvisible = true;
+        player.invisibilityStartTime = GetTime();
+        player.remainingInvisibilityUses--;
+        invisibilityTimer = ScheduleTimer(SimTick() + INVISIBILITY_TICKS, TIMER_INVISIBILITY);
+        EmitTelemetry(TELEMETRY_INVISIBILITY, 0, player.position.x, player.position.y, static_cast<float>(player.remainingInvisibilityUses));
+        QueueSound(SOUND_INVISIBILITY, player.position.x);
+    }
+}
+
+void DropMeteor() {
+    Vector2 position = { static_cast<float>(GameRandom() % (SCREEN_WIDTH - 100) + 50), 0 };
+    SpawnMeteor(position);
+    lastMeteorDropTime = static_cast<int>(timerFiredTick[TIMER_METEOR_DROP] * SIM_TICK_MS);
+    EmitTelemetry(TELEMETRY_METEOR_DROP, 0, position.x, position.y, 0.0f);
+}
+
+// Parallel part of the meteor update, over chunks of the meteor archetype: falling and ground
+// impact touch only the meteor itself. The explosion lifetime is started when the impact resolves.
+void MoveMeteors(int beginChunk, int endChunk, float dt) {
+    Archetype& archetype = MeteorArchetype();
+    for (int chunk = beginChunk; chunk < endChunk; ++chunk) {
+        Position* positions = ChunkComponents<Position>(archetype, chunk);
+        MeteorState* states = ChunkComponents<MeteorState>(archetype, chunk);
+        Lifetime* lifetimes = ChunkComponents<Lifetime>(archetype, chunk);
+        char* impacts = meteorImpacts + chunk * archetype.capacity;
+        int count = std::min(archetype.capacity, archetype.count - chunk * archetype.capacity);
+        for (int i = 0; i < count; ++i) {
+            impacts[i] = 0;
+            if (states[i].hasExploded) continue;
+            float impactTime = (FLOOR_Y - positions[i].value.y) / METEOR_FALL_SPEED;
+            if (impactTime <= dt) {
+                positions[i].value.y = FLOOR_Y;
+                states[i].hasExploded = true;
+                lifetimes[i].startTime = StepTime(std::max(impactTime, 0.0f));
+                impacts[i] = 1;
+            }
+            else {
+                positions[i].value.y += METEOR_FALL_SPEED * dt;
+            }
+        }
+    }
+}
+
+template <typename Mode>
+void ResolveMeteors() {
+    Archetype& archetype = MeteorArchetype();
+    for (int row = 0; row < archetype.count; ++row) {
+        if (!meteorImpacts[row]) continue;
+        Vector2 position = RowComponent<Position>(archetype, row).value;
+        Lifetime& lifetime = RowComponent<Lifetime>(archetype, row);
+        StartLifetime(lifetime, lifetime.startTime, METEOR_EXPLOSION_MS);
+        EmitParticles(position, 10.0f, 8.0f, METEOR_PARTICLES, 1.0f, 0.5f, 0.1f);
+        EmitTelemetry(TELEMETRY_METEOR_EXPLODE, 0, position.x, position.y, 0.0f);
+        QueueSound(SOUND_METEOR, position.x);
+        if (Mode::lethal && !player.isInvisible) {
+            if (fixedPoint) {
+                if (FixedOverlap(ToFixed(player.position), ToFixed(position), ToFixed(METEOR_EXPLOSION_RADIUS))) KillPlayer(DEATH_METEOR);
+            }
+            else {
+                float dist = sqrt(pow(player.position.x - position.x, 2) + pow(player.position.y - position.y, 2));
+                if (dist < METEOR_EXPLOSION_RADIUS) KillPlayer(DEATH_METEOR);
+            }
+        }
+    }
+    ForEachEntity<Position, MeteorState, Lifetime>(world, [](const Position& position, const MeteorState& meteor, const Lifetime& lifetime) {
+        float progress = (GetTime() - lifetime.startTime) / static_cast<float>(METEOR_EXPLOSION_MS);
+        if (meteor.hasExploded && progress < 1.0f) {
+            BubbleEffect effect = { position.value, METEOR_EXPLOSION_RADIUS * progress, BUBBLE_EFFECT_POP, GetTime() };
+            SpawnEffect(effect);
+        }
+    });
+}
+
+void RestartGame();
+
+// x after reflecting off the side walls, for a ball that travels freely from x by dx.
+float FoldBallX(float x, float dx, float radius) {
+    float span = SCREEN_WIDTH - 2 * radius;
+    float u = fmodf(x - radius + dx, 2 * span);
+    if (u < 0) u += 2 * span;
+    return radius + (u > span ? 2 * span - u : u);
+}
+
+// One tick of the autopilot's ball model: the sim's ballistics with reflected wall/floor contacts.
+void PredictBallTick(Vector2& position, Vector2& velocity, float radius) {
+    position.x += velocity.x;
+    if (position.x < radius) { position.x = 2 * radius - position.x; velocity.x = -velocity.x; }
+    else if (position.x > SCREEN_WIDTH - radius) { position.x = 2 * (SCREEN_WIDTH - radius) - position.x; velocity.x = -velocity.x; }
+    position.y += velocity.y + 0.5f * GRAVITY;
+    velocity.y += GRAVITY;
+    if (position.y + radius > FLOOR_Y && velocity.y > 0) { position.y = 2 * (FLOOR_Y - radius) - position.y; velocity.y = -velocity.y; }
+}
+
+// Forward-simulates the nearest balls and falling meteors AUTOPILOT_HORIZON ticks against a few
+// movement plans, holds the keys of the safest one that ends closest to a target, fires when a shot
+// would meet a ball and turns invisible when every plan is hit within AUTOPILOT_PANIC_TICKS.
+void RunAutopilot() {
+    double start = GetWallMillis();
+    if (gameOver) {
+        // Headless runs restart (and count) deaths themselves.
+        if (!headless) RestartGame();
+        return;
+    }
+    float halfWidth = player.width / 2;
+    float planX[AUTOPILOT_PLANS][AUTOPILOT_HORIZON + 1];
+    int firstHit[AUTOPILOT_PLANS];
+    for (int p = 0; p < AUTOPILOT_PLANS; ++p) {
+        float x = player.position.x;
+        planX[p][0] = x;
+        for (int t = 1; t <= AUTOPILOT_HORIZON; ++t) {
+            // The player moves a whole step's distance at the start of each step, as HandleInput does.
+            if ((t - 1) % simStepTicks == 0 && t <= AUTOPILOT_MOVES[p].moveTicks) x += AUTOPILOT_MOVES[p].direction * PLAYER_SPEED * simStepTicks;
+            x = std::max(halfWidth, std::min(SCREEN_WIDTH - halfWidth, x));
+            planX[p][t] = x;
+        }
+        firstHit[p] = AUTOPILOT_HORIZON + 1;
+    }
+    // Hits before the invisibility wears off do not count.
+    int safeTicks = player.isInvisible ? static_cast<int>((player.invisibilityStartTime + INVISIBILITY_DURATION - GetTime()) / SIM_TICK_MS) : 0;
+
+    // Only balls that could reach the player within the horizon, nearest first, capped.
+    AutopilotThreat* threats = ArenaAlloc<AutopilotThreat>(balls.size());
+    int threatCount = 0;
+    for (size_t i = 0; i < balls.size(); ++i) {
+        const Ball& ball = balls[i];
+        float gap = fabs(ball.position.x - player.position.x) - ball.radius - halfWidth - AUTOPILOT_MARGIN;
+        if (gap <= (fabs(ball.velocity.x) + PLAYER_SPEED) * AUTOPILOT_HORIZON) threats[threatCount++] = { gap, static_cast<int>(i) };
+    }
+    if (threatCount > AUTOPILOT_MAX_BALLS) {
+        std::nth_element(threats, threats + AUTOPILOT_MAX_BALLS, threats + threatCount,
+            [](const AutopilotThreat& a, const AutopilotThreat& b) { return a.gap < b.gap; });
+        threatCount = AUTOPILOT_MAX_BALLS;
+    }
+
+    const Weapon& weapon = WEAPONS[player.weapon];
+    float aimSlack = tanf(weapon.spread * 0.5f * static_cast<float>(M_PI) / 180.0f);
+    float targetX = player.position.x, targetGap = 1e9f;
+    bool fire = false;
+    for (int k = 0; k < threatCount; ++k) {
+        Ball ball = balls[threats[k].index];
+        if (eventPhysics) SyncBall(ball, SimTicks());
+        float rise = player.position.y - ball.position.y;
+        if (rise > 0) {
+            float x = FoldBallX(ball.position.x, ball.velocity.x * rise / weapon.speed, ball.radius);
+            if (fabs(x - player.position.x) < ball.radius + rise * aimSlack) fire = true;
+        }
+        Vector2 position = ball.position, velocity = ball.velocity;
+        float reach = ball.radius + halfWidth + AUTOPILOT_MARGIN;
+        for (int t = 1; t <= AUTOPILOT_HORIZON; ++t) {
+            PredictBallTick(position, velocity, ball.radius);
+            float dy = position.y - player.position.y;
+            if (t <= safeTicks || fabs(dy) >= reach) continue;
+            for (int p = 0; p < AUTOPILOT_PLANS; ++p) {
+                float dx = position.x - planX[p][t];
+                if (t < firstHit[p] && dx * dx + dy * dy < reach * reach) firstHit[p] = t;
+            }
+        }
+        float gap = fabs(position.x - player.position.x);
+        if (gap < targetGap) { targetGap = gap; targetX = position.x; }
+    }
+    float meteorReach = METEOR_EXPLOSION_RADIUS + AUTOPILOT_MARGIN, meteorDy = FLOOR_Y - player.position.y;
+    ForEachEntity<Position, MeteorState>(world, [&](const Position& position, const MeteorState& meteor) {
+        if (meteor.hasExploded) return;
+        int impact = std::max(1, static_cast<int>(ceil((FLOOR_Y - position.value.y) / METEOR_FALL_SPEED)));
+        if (impact > AUTOPILOT_HORIZON || impact <= safeTicks) return;
+        for (int p = 0; p < AUTOPILOT_PLANS; ++p) {
+            float dx = position.value.x - planX[p][impact];
+            if (impact < firstHit[p] && dx * dx + meteorDy * meteorDy < meteorReach * meteorReach) firstHit[p] = impact;
+        }
+    });
+
+    // Latest hit wins; among safe plans, the one ending closest to the target (standing still on ties).
+    int best = 0;
+    for (int p = 1; p < AUTOPILOT_PLANS; ++p) {
+        if (firstHit[p] != firstHit[best]) {
+            if (firstHit[p] > firstHit[best]) best = p;
+        }
+        else if (fabs(planX[p][AUTOPILOT_HORIZON] - targetX) < fabs(planX[best][AUTOPILOT_HORIZON] - targetX)) best = p;
+    }
+    int direction = AUTOPILOT_MOVES[best].direction;
+    leftPressed = direction < 0;
+    rightPressed = direction > 0;
+    spacePressed = fire;
+    if (firstHit[best] <= AUTOPILOT_PANIC_TICKS + simStepTicks) invisibilityPressed = true;
+
+    double planMs = GetWallMillis() - start;
+    ++autopilotPlanCount;
+    autopilotTotalMs += planMs;
+    autopilotMaxMs = std::max(autopilotMaxMs, planMs);
+    autopilotAverageMs += (planMs - autopilotAverageMs) * 0.05;
+}
+
+bool PopInputEvent(InputEvent& event);
+void ApplyInputEvent(const InputEvent& event);
+
+void HandleInput() {
+    if (replayRecording && gameOver) StopReplayRecording();
+    InputEvent event;
+    while (PopInputEvent(event)) {
+        if (event.down && (stepInputTime < 0 || event.time < stepInputTime)) stepInputTime = event.time;
+        ApplyInputEvent(event);
+    }
+    if (paused) {
+        leftTapped = rightTapped = spaceTapped = invisibilityPressed = false;
+        return;
+    }
+    if (autopilot) RunAutopilot();
+    if (replayRecording) RecordReplayInput();
+    bool left = leftPressed || leftTapped, right = rightPressed || rightTapped, fire = spacePressed || spaceTapped;
+    leftTapped = rightTapped = spaceTapped = false;
+    player.isMoving = false;
+    if (left) {
+        player.position.x -= PLAYER_SPEED * simStepTicks;
+        player.isMoving = true;
+        player.direction = 1.0f;
+    }
+    if (right) {
+        player.position.x += PLAYER_SPEED * simStepTicks;
+        player.isMoving = true;
+        player.direction = -1.0f;
+    }
+    if (fire) FireWeapon();
+    if (invisibilityPressed) { ActivateInvisibility(); invisibilityPressed = false; }
+    player.position.x = std::max(player.width / 2, std::min(SCREEN_WIDTH - player.width / 2, player.position.x));
+}
+
+// Runs when scoreTimer fires, once a second of play.
+template <typename Mode>
+void UpdateScore() {
+    score += 10;
+    scoreTimer = ScheduleTimer(timerFiredTick[TIMER_SCORE] + SCORE_INTERVAL_TICKS, TIMER_SCORE);
+    CheckBallSpawn<Mode>();
+    if (!Mode::invisibilityRewards) return;
+    int invisibilityRewards = score / INVISIBILITY_REWARD_INTERVAL;
+    int newRewards = invisibilityRewards - (lastInvisibilityRewardScore / INVISIBILITY_REWARD_INTERVAL);
+    if (newRewards > 0) {
+        player.remainingInvisibilityUses += newRewards;
+        lastInvisibilityRewardScore = invisibilityRewards * INVISIBILITY_REWARD_INTERVAL;
+    }
+}
+
+// Every GL submission goes through these so each frame's work can be counted per subsystem.
+inline void RecordDraw(int vertices) {
+    ++renderCounters[renderSubsystem].drawCalls;
+    renderCounters[renderSubsystem].vertices += vertices;
+}
+inline void RecordStateChange() { ++renderCounters[renderSubsystem].stateChanges; }
+inline void BeginBatch(GLenum mode) {
+    glBegin(mode);
+    RecordDraw(0);
+}
+inline void BatchVertex(float x, float y) {
+    glVertex2f(x, y);
+    ++renderCounters[renderSubsystem].vertices;
+}
+inline void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    glDrawArrays(mode, first, count);
+    RecordDraw(count);
+}
+inline void DrawCharacter(void* font, int character) {
+    glutBitmapCharacter(font, character);
+    RecordDraw(0);
+}
+inline void BindTexture(GLuint texture) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    ++renderCounters[renderSubsystem].textureBinds;
+}
+inline void EnableState(GLenum cap) {
+    glEnable(cap);
+    RecordStateChange();
+}
+inline void DisableState(GLenum cap) {
+    glDisable(cap);
+    RecordStateChange();
+}
+inline void SetBlendFunc(GLenum source, GLenum destination) {
+    glBlendFunc(source, destination);
+    RecordStateChange();
+}
+inline void SetLineWidth(float width) {
+    glLineWidth(width);
+    RecordStateChange();
+}
+inline void SetPointSize(float size) {
+    glPointSize(size);
+    RecordStateChange();
+}
+inline void EnableArray(GLenum array) {
+    glEnableClientState(array);
+    RecordStateChange();
+}
+inline void DisableArray(GLenum array) {
+    glDisableClientState(array);
+    RecordStateChange();
+}
+inline void SetTextureMode(GLint mode) {
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+    RecordStateChange();
+}
+
+void RenderShape(float x, float y, float width, float height, float r, float g, float b, float alpha, bool isCircle = false) {
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(r, g, b, alpha);
+    if (isCircle) {
+        int step = QUALITY_TIERS[qualityTier].circleStep;
+        BeginBatch(GL_TRIANGLE_FAN);
+        BatchVertex(x, y);
+        for (int i = 0; i <= 360; i += step) {
+            float angle = i * M_PI / 180;
+            BatchVertex(x + cos(angle) * width, y + sin(angle) * height);
+        }
+        glEnd();
+        glColor4f(1.0f, 1.0f, 1.0f, alpha);
+        BeginBatch(GL_LINE_LOOP);
+        for (int i = 0; i <= 360; i += step) {
+            float angle = i * M_PI / 180;
+            BatchVertex(x + cos(angle) * width, y + sin(angle) * height);
+        }
+        glEnd();
+    }
+    else {
+        BeginBatch(GL_QUADS);
+        BatchVertex(x - width / 2, y - height / 2);
+        BatchVertex(x + width / 2, y - height / 2);
+        BatchVertex(x + width / 2, y + height / 2);
+        BatchVertex(x - width / 2, y + height / 2);
+        glEnd();
+    }
+    DisableState(GL_BLEND);
+}
+
+// Signed-distance shapes: each circle is one quad whose texture coordinates hold the offset from
+// the centre in radii (xy) and the shape kind (w). fwidth gives a one-pixel anti-aliasing band at
+// any scale.
+const char* const SDF_VERTEX_SHADER =
+    "varying vec4 local;\n"
+    "void main() {\n"
+    "    local = gl_MultiTexCoord0;\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+    "}\n";
+const char* const SDF_FRAGMENT_SHADER =
+    "varying vec4 local;\n"
+    "float inside(float d, float aa) { return 1.0 - smoothstep(-aa, aa, d); }\n"
+    "vec4 over(vec4 dst, vec3 rgb, float a) {\n"
+    "    float outA = a + dst.a * (1.0 - a);\n"
+    "    return outA > 0.0 ? vec4((rgb * a + dst.rgb * dst.a * (1.0 - a)) / outA, outA) : vec4(0.0);\n"
+    "}\n"
+    "void main() {\n"
+    "    float d = length(local.xy), aa = fwidth(d), kind = local.w;\n"
+    "    vec4 c = gl_Color, result = vec4(0.0);\n"
+    "    if (kind < 0.5) {\n"
+    "        float h = length(local.xy + vec2(0.3)) / 0.3;\n"
+    "        result = over(result, c.rgb, c.a * inside(d - 1.0, aa));\n"
+    "        result = over(result, vec3(1.0), c.a * inside(abs(d - 1.0) - 0.5 * aa, aa));\n"
+    "        result = over(result, vec3(1.0), 0.3 * inside(h - 1.0, aa / 0.3));\n"
+    "        result = over(result, vec3(1.0), 0.3 * inside(abs(h - 1.0) - 0.5 * aa / 0.3, aa / 0.3));\n"
+    "    } else if (kind < 1.5) {\n"
+    "        result = over(result, c.rgb, c.a * inside(d - 1.0, aa));\n"
+    "        result = over(result, vec3(1.0), c.a * inside(abs(d - 1.0) - 0.5 * aa, aa));\n"
+    "    } else if (kind < 2.5) {\n"
+    "        result = vec4(c.rgb, c.a * (1.0 - smoothstep(0.5, 1.0, d)));\n"
+    "    } else {\n"
+    "        result = vec4(c.rgb, c.a * inside(abs(d - 1.0) - 1.5 * aa, aa));\n"
+    "    }\n"
+    "    gl_FragColor = result;\n"
+    "}\n";
+
+template <typename Proc>
+bool LoadGLProc(Proc& proc, const char* name) {
+#ifdef FREEGLUT
+    proc = reinterpret_cast<Proc>(glutGetProcAddress(name));
+#else
+    proc = nullptr;
+    (void)name;
+#endif
+    return proc != nullptr;
+}
+
+GLuint CompileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShaderPtr(type);
+    glShaderSourcePtr(shader, 1, &source, nullptr);
+    glCompileShaderPtr(shader);
+    GLint ok = 0;
+    glGetShaderivPtr(shader, GL_COMPILE_STATUS, &ok);
+    return ok ? shader : 0;
+}
+
+// Falls back to the fixed-function circles when the driver lacks GLSL or the shaders do not build.
+void InitShaders() {
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (!useShaders || !version || atoi(version) < 2) {
+        useShaders = false;
+        return;
+    }
+    bool loaded = LoadGLProc(glCreateShaderPtr, "glCreateShader") && LoadGLProc(glShaderSourcePtr, "glShaderSource")
+        && LoadGLProc(glCompileShaderPtr, "glCompileShader") && LoadGLProc(glGetShaderivPtr, "glGetShaderiv")
+        && LoadGLProc(glCreateProgramPtr, "glCreateProgram") && LoadGLProc(glAttachShaderPtr, "glAttachShader")
+        && LoadGLProc(glLinkProgramPtr, "glLinkProgram") && LoadGLProc(glGetProgramivPtr, "glGetProgramiv")
+        && LoadGLProc(glUseProgramPtr, "glUseProgram");
+    GLuint vertexShader = loaded ? CompileShader(GL_VERTEX_SHADER, SDF_VERTEX_SHADER) : 0;
+    GLuint fragmentShader = loaded ? CompileShader(GL_FRAGMENT_SHADER, SDF_FRAGMENT_SHADER) : 0;
+    if (vertexShader && fragmentShader) {
+        sdfProgram = glCreateProgramPtr();
+        glAttachShaderPtr(sdfProgram, vertexShader);
+        glAttachShaderPtr(sdfProgram, fragmentShader);
+        glLinkProgramPtr(sdfProgram);
+        GLint ok = 0;
+        glGetProgramivPtr(sdfProgram, GL_LINK_STATUS, &ok);
+        if (!ok) sdfProgram = 0;
+    }
+    useShaders = sdfProgram != 0;
+    if (!useShaders) std::cerr << "GLSL unavailable, using fixed-function bubbles" << std::endl;
+}
+
+// Timer queries need ARB_timer_query (core in 3.3) or EXT_timer_query; without them the governor
+// sees only the CPU side of the frame on hardware drivers.
+void InitGpuTimer() {
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (finishFrames || !extensions || (!strstr(extensions, "GL_ARB_timer_query") && !strstr(extensions, "GL_EXT_timer_query"))) return;
+    gpuTiming = LoadGLProc(glGenQueriesPtr, "glGenQueries") && LoadGLProc(glBeginQueryPtr, "glBeginQuery")
+        && LoadGLProc(glEndQueryPtr, "glEndQuery") && LoadGLProc(glGetQueryObjectivPtr, "glGetQueryObjectiv")
+        && (LoadGLProc(glGetQueryObjectui64vPtr, "glGetQueryObjectui64v") || LoadGLProc(glGetQueryObjectui64vPtr, "glGetQueryObjectui64vEXT"));
+    if (gpuTiming) glGenQueriesPtr(GPU_TIMER_QUERIES, gpuTimerQueries);
+}
+
+// Reads back every finished query, oldest first, then starts timing this frame. A query the GPU
+// still has not finished when its slot comes round again is dropped.
+void BeginGpuTimer() {
+    if (!gpuTiming) return;
+    for (int i = 0; i < GPU_TIMER_QUERIES; ++i) {
+        int slot = (gpuTimerSlot + i) % GPU_TIMER_QUERIES;
+        if (!gpuTimerPending[slot]) continue;
+        GLint available = 0;
+        glGetQueryObjectivPtr(gpuTimerQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        unsigned long long nanoseconds = 0;
+        glGetQueryObjectui64vPtr(gpuTimerQueries[slot], GL_QUERY_RESULT, &nanoseconds);
+        gpuFrameMs = nanoseconds / 1e6;
+        gpuTimerPending[slot] = false;
+    }
+    glBeginQueryPtr(GL_TIME_ELAPSED, gpuTimerQueries[gpuTimerSlot]);
+    gpuTimerPending[gpuTimerSlot] = true;
+}
+
+void EndGpuTimer() {
+    if (!gpuTiming) return;
+    glEndQueryPtr(GL_TIME_ELAPSED);
+    gpuTimerSlot = (gpuTimerSlot + 1) % GPU_TIMER_QUERIES;
+}
+
+// Queues one SDF quad; the outer margin leaves room for the outline and its anti-aliasing.
+void PushSdfQuad(float x, float y, float radius, int kind, float r, float g, float b, float alpha) {
+    float extent = 1.0f + 3.0f / std::max(radius, 1.0f), size = radius * extent;
+    const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+    for (const auto& corner : corners) {
+        sdfVertices.push_back(x + corner[0] * size);
+        sdfVertices.push_back(y + corner[1] * size);
+        sdfCoords.push_back(corner[0] * extent);
+        sdfCoords.push_back(corner[1] * extent);
+        sdfCoords.push_back(0.0f);
+        sdfCoords.push_back(static_cast<float>(kind));
+        sdfColors.push_back(r);
+        sdfColors.push_back(g);
+        sdfColors.push_back(b);
+        sdfColors.push_back(alpha);
+    }
+    // The flush is one draw call for every subsystem's quads; vertices are charged as queued.
+    renderCounters[renderSubsystem].vertices += 4;
+}
+
+void FlushSdfQuads() {
+    if (sdfVertices.empty()) return;
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgramPtr(sdfProgram);
+    RecordStateChange();
+    EnableArray(GL_VERTEX_ARRAY);
+    EnableArray(GL_TEXTURE_COORD_ARRAY);
+    EnableArray(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, sdfVertices.data());
+    glTexCoordPointer(4, GL_FLOAT, 0, sdfCoords.data());
+    glColorPointer(4, GL_FLOAT, 0, sdfColors.data());
+    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(sdfVertices.size() / 2));
+    RecordDraw(0);
+    DisableArray(GL_COLOR_ARRAY);
+    DisableArray(GL_TEXTURE_COORD_ARRAY);
+    DisableArray(GL_VERTEX_ARRAY);
+    glUseProgramPtr(0);
+    RecordStateChange();
+    DisableState(GL_BLEND);
+    sdfVertices.clear();
+    sdfCoords.clear();
+    sdfColors.clear();
+}
+
+void RenderTexture(GLuint texture, float x, float y, float width, float height, float alpha, bool flipX = false) {
+    EnableState(GL_TEXTURE_2D);
+    BindTexture(texture);
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(1.0f, 1.0f, 1.0f, alpha);
+    glPushMatrix();
+    glTranslatef(x, y, 0.0f);
+    if (flipX) glScalef(-1.0f, 1.0f, 1.0f);
+    BeginBatch(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); BatchVertex(-width / 2, -height / 2);
+    glTexCoord2f(1.0f, 0.0f); BatchVertex(width / 2, -height / 2);
+    glTexCoord2f(1.0f, 1.0f); BatchVertex(width / 2, height / 2);
+    glTexCoord2f(0.0f, 1.0f); BatchVertex(-width / 2, height / 2);
+    glEnd();
+    glPopMatrix();
+    DisableState(GL_TEXTURE_2D);
+    DisableState(GL_BLEND);
+}
+
+void RenderPlayer(const Player& player) {
+    float alpha = player.isInvisible ? 0.3f : 1.0f;
+    RenderTexture(ufoTexture, player.position.x, player.position.y, player.width, player.height, alpha, player.direction < 0);
+    if (player.isInvisible && QUALITY_TIERS[qualityTier].glow) {
+        float pulse = 0.5f + 0.5f * sin(GetWallTime() / 100.0f);
+        if (useShaders) {
+            PushSdfQuad(player.position.x, player.position.y, player.width / 2 + 10, SDF_GLOW, 0.3f, 0.8f, 1.0f, 0.4f * pulse);
+            FlushSdfQuads();
+        }
+        else {
+            RenderShape(player.position.x, player.position.y, player.width / 2 + 10, player.width / 2 + 10, 0.3f, 0.8f, 1.0f, 0.2f * pulse, true);
+        }
+    }
+}
+
+// Effects fade out over EFFECT_LIFETIME_MS of sim time; ones past it await the next sweep.
+void RenderBubbleEffect(Vector2 position, const EffectShape& effect, int startTime, int simTime) {
+    float alpha = 1.0f - static_cast<float>(simTime - startTime) / EFFECT_LIFETIME_MS;
+    if (alpha < 0.0f) return;
+    const QualityTier& quality = QUALITY_TIERS[qualityTier];
+    float pulse = quality.glow ? 0.5f + 0.5f * sin(GetWallTime() / 100.0f) : 0.0f;
+    float radius = effect.radius * (1.0f + pulse * 0.2f * (1.0f - alpha));
+    // Without glows a split is one disc rather than five.
+    int pieces = quality.glow ? 5 : 1;
+    if (useShaders) {
+        if (effect.type == BUBBLE_EFFECT_BOUNCE) {
+            PushSdfQuad(position.x, position.y, radius, SDF_DISC, 0.7f, 0.8f, 1.0f, alpha * 0.6f);
+        }
+        else if (effect.type == BUBBLE_EFFECT_POP) {
+            PushSdfQuad(position.x, position.y, radius, SDF_RING, 0.9f, 0.95f, 1.0f, alpha * 0.8f);
+        }
+        else if (pieces == 1) {
+            PushSdfQuad(position.x, position.y, radius * 0.5f, SDF_DISC, 0.8f, 0.9f, 1.0f, alpha * 0.7f);
+        }
+        else {
+            for (int i = 0; i < pieces; i++) {
+                float smallRadius = radius * (0.3f + 0.1f * sin(GetWallTime() / 100.0f + i));
+                PushSdfQuad(position.x + cos(i * 72 * M_PI / 180) * radius * 0.5f, position.y + sin(i * 72 * M_PI / 180) * radius * 0.5f,
+                    smallRadius, SDF_DISC, 0.8f, 0.9f, 1.0f, alpha * 0.7f);
+            }
+        }
+        return;
+    }
+    if (effect.type == BUBBLE_EFFECT_BOUNCE) {
+        RenderShape(position.x, position.y, radius, radius, 0.7f, 0.8f, 1.0f, alpha * 0.6f, true);
+    }
+    else if (effect.type == BUBBLE_EFFECT_POP) {
+        EnableState(GL_BLEND);
+        SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glColor4f(0.9f, 0.95f, 1.0f, alpha * 0.8f);
+        SetLineWidth(3.0f);
+        BeginBatch(GL_LINE_LOOP);
+        for (int i = 0; i <= 360; i += std::max(20, quality.circleStep)) {
+            float angle = i * M_PI / 180;
+            BatchVertex(position.x + cos(angle) * radius, position.y + sin(angle) * radius);
+        }
+        glEnd();
+        SetLineWidth(1.0f);
+        DisableState(GL_BLEND);
+    }
+    else if (pieces == 1) {
+        RenderShape(position.x, position.y, radius * 0.5f, radius * 0.5f, 0.8f, 0.9f, 1.0f, alpha * 0.7f, true);
+    }
+    else {
+        for (int i = 0; i < pieces; i++) {
+            float offsetX = cos(i * 72 * M_PI / 180) * radius * 0.5f;
+            float offsetY = sin(i * 72 * M_PI / 180) * radius * 0.5f;
+            float smallRadius = radius * (0.3f + 0.1f * sin(GetWallTime() / 100.0f + i));
+            RenderShape(position.x + offsetX, position.y + offsetY, smallRadius, smallRadius, 0.8f, 0.9f, 1.0f, alpha * 0.7f, true);
+        }
+    }
+}
+
+void RecordBallTrails() {
+    double now = SimTicks();
+    for (auto& ball : balls) {
+        Vector2 position = ball.position;
+        if (eventPhysics && ball.hotSlot < 0) {
+            Ball current = ball;
+            SyncBall(current, now);
+            position = current.position;
+        }
+        ball.trailHead = (ball.trailHead + 1) % MAX_TRAIL_LENGTH;
+        ball.trail[ball.trailHead] = position;
+        ball.trailCount = std::min(ball.trailCount + 1, MAX_TRAIL_LENGTH);
+    }
+}
+
+void PushTrailVertex(float x, float y, float alpha) {
+    trailVertices.push_back(x);
+    trailVertices.push_back(y);
+    trailColors.push_back(0.8f);
+    trailColors.push_back(0.9f);
+    trailColors.push_back(1.0f);
+    trailColors.push_back(alpha);
+}
+
+// All trails go into one triangle strip; consecutive ribbons are joined with degenerate triangles.
+void RenderBubbleTrails(const std::vector<Ball>& balls) {
+    trailVertices.clear();
+    trailColors.clear();
+    for (const auto& ball : balls) {
+        int count = std::min(ball.trailCount, std::min(trailLength, QUALITY_TIERS[qualityTier].trailLength));
+        if (count < 2) continue;
+        bool first = true;
+        for (int i = 0; i < count; ++i) {
+            const Vector2& p = ball.trail[(ball.trailHead - i + MAX_TRAIL_LENGTH) % MAX_TRAIL_LENGTH];
+            const Vector2& q = ball.trail[(ball.trailHead - std::min(i + 1, count - 1) + MAX_TRAIL_LENGTH) % MAX_TRAIL_LENGTH];
+            const Vector2& o = ball.trail[(ball.trailHead - std::max(i - 1, 0) + MAX_TRAIL_LENGTH) % MAX_TRAIL_LENGTH];
+            float dx = o.x - q.x, dy = o.y - q.y;
+            float length = sqrt(dx * dx + dy * dy);
+            float t = static_cast<float>(i) / (count - 1);
+            float halfWidth = ball.radius * 0.3f * (1.0f - t);
+            float nx = length > 1e-4f ? -dy / length * halfWidth : 0.0f, ny = length > 1e-4f ? dx / length * halfWidth : 0.0f;
+            float alpha = 0.3f * (1.0f - t);
+            if (first && !trailVertices.empty()) PushTrailVertex(p.x + nx, p.y + ny, 0.0f);
+            PushTrailVertex(p.x + nx, p.y + ny, alpha);
+            PushTrailVertex(p.x - nx, p.y - ny, alpha);
+            first = false;
+        }
+        size_t last = trailVertices.size() - 2;
+        PushTrailVertex(trailVertices[last], trailVertices[last + 1], 0.0f);
+    }
+    if (trailVertices.empty()) return;
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    EnableArray(GL_VERTEX_ARRAY);
+    EnableArray(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, trailVertices.data());
+    glColorPointer(4, GL_FLOAT, 0, trailColors.data());
+    DrawArrays(GL_TRIANGLE_STRIP, 0, static_cast<GLsizei>(trailVertices.size() / 2));
+    DisableArray(GL_COLOR_ARRAY);
+    DisableArray(GL_VERTEX_ARRAY);
+    DisableState(GL_BLEND);
+}
+
+int GridColumn(float x) { return std::max(0, std::min(GRID_COLUMNS - 1, static_cast<int>(floor(x / GRID_CELL_SIZE)))); }
+int GridRow(float y) { return std::max(0, std::min(GRID_ROWS - 1, static_cast<int>(floor(y / GRID_CELL_SIZE)))); }
+
+GridRange PathBounds(const BallPath& path, float radius) {
+    float x0 = 1e9f, y0 = 1e9f, x1 = -1e9f, y1 = -1e9f;
+    for (int i = 0; i < path.count; ++i) {
+        const BallSegment& segment = path.segments[i];
+        Vector2 a = SegmentPosition(segment, segment.startTime), b = SegmentPosition(segment, segment.endTime);
+        x0 = std::min(x0, std::min(a.x, b.x)); x1 = std::max(x1, std::max(a.x, b.x));
+        y0 = std::min(y0, std::min(a.y, b.y)); y1 = std::max(y1, std::max(a.y, b.y));
+        float apex = segment.startTime - segment.velocity.y / GRAVITY;
+        if (apex > segment.startTime && apex < segment.endTime) y0 = std::min(y0, SegmentPosition(segment, apex).y);
+    }
+    return { GridColumn(x0 - radius), GridRow(y0 - radius), GridColumn(x1 + radius), GridRow(y1 + radius) };
+}
+
+// Counting sort of grid.ranges into per-cell item lists; an empty range (x1 < x0) adds nothing.
+void BucketGridRanges(BallGrid& grid) {
+    int count = static_cast<int>(grid.ranges.size());
+    grid.cellStart.assign(GRID_COLUMNS * GRID_ROWS + 1, 0);
+    for (const auto& range : grid.ranges) {
+        for (int y = range.y0; y <= range.y1; ++y) {
+            for (int x = range.x0; x <= range.x1; ++x) ++grid.cellStart[y * GRID_COLUMNS + x + 1];
+        }
+    }
+    for (int cell = 0; cell < GRID_COLUMNS * GRID_ROWS; ++cell) grid.cellStart[cell + 1] += grid.cellStart[cell];
+    grid.items.resize(grid.cellStart.back());
+    for (int i = 0; i < count; ++i) {
+        const GridRange& range = grid.ranges[i];
+        for (int y = range.y0; y <= range.y1; ++y) {
+            for (int x = range.x0; x <= range.x1; ++x) grid.items[grid.cellStart[y * GRID_COLUMNS + x]++] = i;
+        }
+    }
+    for (int cell = GRID_COLUMNS * GRID_ROWS; cell > 0; --cell) grid.cellStart[cell] = grid.cellStart[cell - 1];
+    grid.cellStart[0] = 0;
+}
+
+// Meteors have already fallen this step, so each covers its hit radius around the path back up to
+// where it started. Exploded meteors cannot be hit and get an empty range.
+void BuildMeteorGrid(float dt) {
+    Archetype& meteors = MeteorArchetype();
+    meteorGrid.ranges.resize(meteors.count);
+    ForEachChunk<Position, MeteorState>(world, [dt, row = 0](int count, const Position* positions, const MeteorState* states) mutable {
+        for (int i = 0; i < count; ++i, ++row) {
+            Vector2 p = positions[i].value;
+            meteorGrid.ranges[row] = states[i].hasExploded ? GridRange{ 0, 0, -1, -1 }
+                : GridRange{ GridColumn(p.x - METEOR_HIT_RADIUS), GridRow(p.y - METEOR_FALL_SPEED * dt - METEOR_HIT_RADIUS),
+                    GridColumn(p.x + METEOR_HIT_RADIUS), GridRow(p.y + METEOR_HIT_RADIUS) };
+        }
+    });
+    BucketGridRanges(meteorGrid);
+}
+
+void BuildBallGrid() {
+    int count = static_cast<int>(balls.size());
+    ballGrid.ranges.resize(count);
+    ParallelFor(count, BALL_JOB_GRAIN, [](int begin, int end, int) {
+        for (int i = begin; i < end; ++i) ballGrid.ranges[i] = PathBounds(ballPaths[i], balls[i].radius);
+    });
+    BucketGridRanges(ballGrid);
+    ballGrid.current.resize(count);
+    ballGrid.origin.resize(count);
+    for (int i = 0; i < count; ++i) ballGrid.current[i] = ballGrid.origin[i] = i;
+    ballGrid.added.clear();
+}
+
+// Cells the shot can touch this step. Beams cover their whole column above the player.
+GridRange ShotBounds(const Projectile& shot, float fromTime, float dt) {
+    if (shot.isBeam) return { GridColumn(shot.startX), 0, GridColumn(shot.startX), GridRow(player.position.y) };
+    float xa = shot.position.x + shot.velocity.x * fromTime, ya = shot.position.y + shot.velocity.y * fromTime;
+    float xb = shot.position.x + shot.velocity.x * dt, yb = shot.position.y + shot.velocity.y * dt;
+    return { GridColumn(std::min(xa, xb) - BOLT_RADIUS), GridRow(std::min(ya, yb) - BOLT_RADIUS),
+        GridColumn(std::max(xa, xb) + BOLT_RADIUS), GridRow(std::max(ya, yb) + BOLT_RADIUS) };
+}
+
+// Earliest ball or meteor the projectile reaches after its from-time this step. Meteors are encoded
+// as targets below NO_TARGET.
+void FindProjectileHit(int shotIndex, float dt) {
+    const Projectile& shot = projectiles[shotIndex];
+    float from = projectileFromTimes[shotIndex], hitTime = -1.0f;
+    int target = NO_TARGET;
+    // Ties go to the lowest ball index, whatever order the grid yields candidates in.
+    auto test = [&](int index) {
+        float t = ShotTimeOfImpact(shot, index, from, dt);
+        if (t >= 0 && (hitTime < 0 || t < hitTime || (t == hitTime && index < target))) { hitTime = t; target = index; }
+    };
+    GridRange query = ShotBounds(shot, from, dt);
+    for (int y = query.y0; y <= query.y1; ++y) {
+        for (int x = query.x0; x <= query.x1; ++x) {
+            int cell = y * GRID_COLUMNS + x;
+            for (int k = ballGrid.cellStart[cell]; k < ballGrid.cellStart[cell + 1]; ++k) {
+                int item = ballGrid.items[k];
+                const GridRange& range = ballGrid.ranges[item];
+                // A ball spanning several queried cells is tested only in the first of them.
+                if (x != std::max(range.x0, query.x0) || y != std::max(range.y0, query.y0)) continue;
+                if (ballGrid.current[item] >= 0) test(ballGrid.current[item]);
+            }
+        }
+    }
+    for (int index : ballGrid.added) test(index);
+    // A meteor must be strictly earlier to beat a ball; between meteors the lowest row wins.
+    Archetype& meteors = MeteorArchetype();
+    for (int y = query.y0; y <= query.y1; ++y) {
+        for (int x = query.x0; x <= query.x1; ++x) {
+            int cell = y * GRID_COLUMNS + x;
+            for (int k = meteorGrid.cellStart[cell]; k < meteorGrid.cellStart[cell + 1]; ++k) {
+                int row = meteorGrid.items[k];
+                const GridRange& range = meteorGrid.ranges[row];
+                if (x != std::max(range.x0, query.x0) || y != std::max(range.y0, query.y0)) continue;
+                float t = MeteorTimeOfImpact(RowComponent<Position>(meteors, row).value, RowComponent<MeteorState>(meteors, row), shot, from, dt);
+                int candidate = NO_TARGET - 1 - row;
+                if (t >= 0 && (hitTime < 0 || t < hitTime || (t == hitTime && target < NO_TARGET && candidate > target))) { hitTime = t; target = candidate; }
+            }
+        }
+    }
+    projectileHitTimes[shotIndex] = hitTime;
+    projectileHitTargets[shotIndex] = target;
+}
+
+// Pops balls[hitIndex] at hitTime (hitPoint is where the shot struck) and finishes the step for any
+// new balls. Returns the index of the first appended ball; splits reports whether hitIndex now
+// holds a child rather than the previous last ball.
+template <typename Mode>
+size_t PopBall(size_t hitIndex, float hitTime, float dt, Vector2 hitPoint, bool& splits) {
+    const BallSegment& segment = PathSegmentAt(ballPaths[hitIndex], hitTime);
+    balls[hitIndex].position = SegmentPosition(segment, hitTime);
+    balls[hitIndex].velocity = SegmentVelocity(segment, hitTime);
+    splits = balls[hitIndex].radius > 20;
+    bool hitPlayerFirst = false;
+    if (Mode::lethal && !player.isInvisible) {
+        float t = PlayerTimeOfImpact(ballPaths[hitIndex], balls[hitIndex].radius);
+        hitPlayerFirst = t >= 0 && t < hitTime;
+    }
+    BubbleEffect effect = { balls[hitIndex].position, balls[hitIndex].radius, BUBBLE_EFFECT_POP, StepTime(hitTime) };
+    SpawnEffect(effect);
+    EmitParticles(hitPoint, 4.0f, 6.0f, POP_PARTICLES, 0.4f, 1.0f, 0.4f);
+    size_t oldCount = balls.size();
+    SplitBall<Mode>(static_cast<int>(hitIndex));
+    if (hitPlayerFirst) KillPlayer(DEATH_BALL);
+    // SplitBall swap-removes the popped ball: either a child or the previous last ball now sits in
+    // its slot, and any other new balls were appended. New balls finish the step from the hit.
+    if (!splits) ballPaths[hitIndex] = ballPaths[oldCount - 1];
+    ballPaths.resize(balls.size());
+    size_t firstNew = splits ? oldCount : oldCount - 1;
+    for (size_t i = firstNew; i < balls.size(); ++i) AdvanceBall(balls[i], hitTime, dt - hitTime, ballPaths[i]);
+    if (splits) AdvanceBall(balls[hitIndex], hitTime, dt - hitTime, ballPaths[hitIndex]);
+    if (eventPhysics) {
+        double now = SimTicks();
+        for (size_t i = firstNew; i < balls.size(); ++i) {
+            balls[i].time = now;
+            ClassifyBall(static_cast<int>(i));
+        }
+        if (splits) {
+            balls[hitIndex].time = now;
+            ClassifyBall(static_cast<int>(hitIndex));
+        }
+    }
+    return firstNew;
+}
+
+void ReplaceAddedBall(int from, int to) {
+    for (size_t k = 0; k < ballGrid.added.size(); ++k) {
+        if (ballGrid.added[k] != from) continue;
+        if (to >= 0) ballGrid.added[k] = to;
+        else { ballGrid.added[k] = ballGrid.added.back(); ballGrid.added.pop_back(); }
+        return;
+    }
+}
+
+// Mirrors PopBall's swap-remove in the grid's index maps.
+void TrackPoppedBall(int poppedIndex, size_t oldCount, size_t firstNew, bool splits) {
+    int dead = ballGrid.origin[poppedIndex];
+    if (dead >= 0) ballGrid.current[dead] = -1;
+    else ReplaceAddedBall(poppedIndex, -1);
+    int last = static_cast<int>(oldCount) - 1;
+    if (splits) {
+        ballGrid.origin[poppedIndex] = -1;
+        ballGrid.added.push_back(poppedIndex);
+    }
+    else if (poppedIndex != last) {
+        int moved = ballGrid.origin[last];
+        ballGrid.origin[poppedIndex] = moved;
+        if (moved >= 0) ballGrid.current[moved] = poppedIndex;
+        else ReplaceAddedBall(last, poppedIndex);
+    }
+    ballGrid.origin.resize(balls.size());
+    for (size_t i = firstNew; i < balls.size(); ++i) {
+        ballGrid.origin[i] = -1;
+        ballGrid.added.push_back(static_cast<int>(i));
+    }
+}
+
+// Keeps the other projectiles' pending hits valid after a ball pop: targets that vanished are
+// searched again, the ball swapped into the popped slot is renamed, and new balls are tested.
+void RetargetProjectiles(int skip, int poppedIndex, size_t firstNew, bool splits, float dt) {
+    int movedFrom = splits ? NO_TARGET : static_cast<int>(firstNew);
+    for (int p = 0; p < projectileCount; ++p) {
+        if (p == skip || !projectiles[p].isActive) continue;
+        int& target = projectileHitTargets[p];
+        if (target == poppedIndex) {
+            FindProjectileHit(p, dt);
+            continue;
+        }
+        if (target == movedFrom && movedFrom != NO_TARGET) target = poppedIndex;
+        auto check = [&](size_t i) {
+            float t = ShotTimeOfImpact(projectiles[p], static_cast<int>(i), projectileFromTimes[p], dt);
+            if (t >= 0 && (target == NO_TARGET || t < projectileHitTimes[p])) {
+                projectileHitTimes[p] = t;
+                target = static_cast<int>(i);
+            }
+        };
+        if (splits) check(static_cast<size_t>(poppedIndex));
+        for (size_t i = firstNew; i < balls.size(); ++i) check(i);
+    }
+}
+
+// All projectiles are collided in one batched pass: first hits are found in parallel, then hits are
+// applied in time order, updating only the projectiles a hit affects.
+template <typename Mode>
+void UpdateProjectiles(float dt) {
+    int count = projectileCount;
+    if (count == 0) return;
+    projectileHitTimes = ArenaAlloc<float>(count);
+    projectileFromTimes = ArenaAlloc<float>(count);
+    projectileHitTargets = ArenaAlloc<int>(count);
+    BuildBallGrid();
+    BuildMeteorGrid(dt);
+    ParallelFor(count, PROJECTILE_JOB_GRAIN, [dt](int begin, int end, int) {
+        for (int p = begin; p < end; ++p) {
+            projectileFromTimes[p] = 0.0f;
+            FindProjectileHit(p, dt);
+        }
+    });
+    for (;;) {
+        int shotIndex = -1;
+        for (int p = 0; p < count; ++p) {
+            if (projectileHitTargets[p] == NO_TARGET) continue;
+            if (shotIndex < 0 || projectileHitTimes[p] < projectileHitTimes[shotIndex]) shotIndex = p;
+        }
+        if (shotIndex < 0) break;
+        Projectile& shot = projectiles[shotIndex];
+        float hitTime = projectileHitTimes[shotIndex];
+        int target = projectileHitTargets[shotIndex];
+        Vector2 hitPoint = shot.isBeam ? Vector2{ shot.startX, shot.position.y - LASER_SPEED * hitTime }
+            : Vector2{ shot.position.x + shot.velocity.x * hitTime, shot.position.y + shot.velocity.y * hitTime };
+        EmitTelemetry(TELEMETRY_SHOT_HIT, shot.weapon, hitPoint.x, hitPoint.y, target >= 0 ? balls[target].radius : 0.0f);
+        if (target >= 0) {
+            bool splits;
+            size_t oldCount = balls.size();
+            size_t firstNew = PopBall<Mode>(static_cast<size_t>(target), hitTime, dt, hitPoint, splits);
+            TrackPoppedBall(target, oldCount, firstNew, splits);
+            RetargetProjectiles(shotIndex, target, firstNew, splits, dt);
+        }
+        else {
+            Archetype& meteors = MeteorArchetype();
+            int row = NO_TARGET - 1 - target;
+            Vector2& position = RowComponent<Position>(meteors, row).value;
+            position.y -= METEOR_FALL_SPEED * (dt - hitTime);
+            RowComponent<MeteorState>(meteors, row).hasExploded = true;
+            StartLifetime(RowComponent<Lifetime>(meteors, row), StepTime(hitTime), METEOR_EXPLOSION_MS);
+            EmitParticles(position, 10.0f, 8.0f, METEOR_PARTICLES / 2, 1.0f, 0.5f, 0.1f);
+            EmitTelemetry(TELEMETRY_METEOR_EXPLODE, 1, position.x, position.y, 0.0f);
+            QueueSound(SOUND_METEOR, position.x, 0.7f);
+            for (int p = 0; p < count; ++p) {
+                if (p != shotIndex && projectileHitTargets[p] == target) FindProjectileHit(p, dt);
+            }
+        }
+        if (shot.isBeam || shot.pierce == 0) {
+            shot.isActive = false;
+            projectileHitTargets[shotIndex] = NO_TARGET;
+        }
+        else {
+            --shot.pierce;
+            projectileFromTimes[shotIndex] = hitTime;
+            FindProjectileHit(shotIndex, dt);
+        }
+    }
+}
+
+// Moves the surviving projectiles to the end of the step and compacts the pool in order.
+void MoveProjectiles(float dt) {
+    int kept = 0;
+    for (int p = 0; p < projectileCount; ++p) {
+        Projectile& shot = projectiles[p];
+        if (!shot.isActive) continue;
+        if (shot.isBeam) {
+            shot.position.y -= LASER_SPEED * dt;
+            if (shot.position.y < 0) continue;
+        }
+        else {
+            shot.position.x += shot.velocity.x * dt;
+            shot.position.y += shot.velocity.y * dt;
+            if (shot.position.y < -10 || shot.position.x < -10 || shot.position.x > SCREEN_WIDTH + 10) continue;
+        }
+        projectiles[kept++] = shot;
+    }
+    projectileCount = kept;
+}
+
+template <typename Mode>
+void UpdateBallsEventDriven(float dt) {
+    double now = SimTicks(), stepStart = now - dt;
+    ballPaths.resize(balls.size());
+    for (int index : hotBalls) {
+        SyncBall(balls[index], stepStart);
+        AdvanceBall(balls[index], 0.0f, dt, ballPaths[index]);
+        balls[index].time = now;
+    }
+    if (projectileCount > 0) {
+        // Shots can reach any ball, so cold balls get a throwaway path for this step.
+        for (size_t i = 0; i < balls.size(); ++i) {
+            if (balls[i].hotSlot >= 0) continue;
+            Ball copy = balls[i];
+            SyncBall(copy, stepStart);
+            AdvanceBall(copy, 0.0f, dt, ballPaths[i], false);
+        }
+        UpdateProjectiles<Mode>(dt);
+    }
+    ProcessBallEvents(stepStart, now);
+    if (Mode::lethal && !player.isInvisible) {
+        for (int index : hotBalls) {
+            if (PlayerTimeOfImpact(ballPaths[index], balls[index].radius) >= 0) {
+                KillPlayer(DEATH_BALL);
+                break;
+            }
+        }
+    }
+    for (size_t slot = 0; slot < hotBalls.size();) {
+        int index = hotBalls[slot];
+        if (balls[index].position.y < BandY(balls[index]) && balls[index].velocity.y < 0) {
+            RemoveHotBall(index);
+            ScheduleBall(index);
+        }
+        else {
+            ++slot;
+        }
+    }
+}
+
+// Stress mode: ramp entity counts linearly to their targets over swarmRampSeconds of sim time,
+// topping meteors and effects back up as they expire.
+void UpdateSwarm() {
+    float ramp = std::min(1.0f, (GetTime() - gameStartTime) / (swarmRampSeconds * 1000.0f));
+    size_t ballTarget = static_cast<size_t>(swarmBalls * ramp);
+    size_t meteorTarget = static_cast<size_t>(swarmMeteors * ramp);
+    size_t effectTarget = static_cast<size_t>(swarmEffects * ramp);
+    while (balls.size() < ballTarget) {
+        SpawnBall(50.0f + static_cast<float>(GameRandom() % (SCREEN_WIDTH - 100)), 50.0f + static_cast<float>(GameRandom() % 200), 10.0f + static_cast<float>(GameRandom() % 21));
+    }
+    while (EntityCount<MeteorState>(world) < meteorTarget) {
+        Vector2 position = { static_cast<float>(GameRandom() % (SCREEN_WIDTH - 100) + 50), static_cast<float>(GameRandom() % (SCREEN_HEIGHT / 2)) };
+        SpawnMeteor(position);
+    }
+    while (EntityCount<EffectShape>(world) < effectTarget) {
+        BubbleEffect effect = { {static_cast<float>(GameRandom() % SCREEN_WIDTH), static_cast<float>(GameRandom() % SCREEN_HEIGHT)}, 5.0f + GameRandom() % 20, GameRandom() % 3, GetTime() - GameRandom() % 500 };
+        SpawnEffect(effect);
+    }
+    int projectileTarget = static_cast<int>(swarmProjectiles * ramp);
+    while (projectileCount < projectileTarget) {
+        int weapon = WEAPON_SPREAD + GameRandom() % (WEAPON_COUNT - WEAPON_SPREAD);
+        float angle = (GameRandom() % 61 - 30) * static_cast<float>(M_PI) / 180.0f, speed = WEAPONS[weapon].speed;
+        Projectile shot = { {static_cast<float>(GameRandom() % SCREEN_WIDTH), FLOOR_Y - 20}, { speed * sinf(angle), -speed * cosf(angle) }, 0, weapon, WEAPONS[weapon].pierce, true, false, {}, {} };
+        shot.fixedPosition = ToFixed(shot.position);
+        shot.fixedVelocity = ToFixed(shot.velocity);
+        if (!SpawnProjectile(shot)) break;
+    }
+}
+
+void RecordSwarmFrame(double simMs, double renderMs, double second, size_t ballCount, size_t meteorCount, size_t effectCount) {
+    double now = GetWallMillis();
+    if (swarmFrames == 0 && swarmWindowStart == 0) swarmWindowStart = now;
+    swarmSimMs += simMs;
+    swarmRenderMs += renderMs;
+    ++swarmFrames;
+    if (now - swarmWindowStart < 1000.0) return;
+    swarmCurrent = { second, ballCount, meteorCount, effectCount, particles.count,
+        swarmSimMs / swarmFrames, swarmRenderMs / swarmFrames, swarmFrames * 1000.0 / (now - swarmWindowStart) };
+    swarmSamples.push_back(swarmCurrent);
+    swarmSimMs = swarmRenderMs = 0;
+    swarmFrames = 0;
+    swarmWindowStart = now;
+}
+
+void WriteSwarmSummary() {
+    if (!swarmMode) return;
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, swarmSummaryFile, "w") != 0) file = nullptr;
+#else
+    FILE* file = fopen(swarmSummaryFile, "w");
+#endif
+    if (!file) {
+        std::cerr << "Failed to write swarm summary: " << swarmSummaryFile << std::endl;
+        return;
+    }
+    SwarmSample peak = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    const SwarmSample* below60 = nullptr;
+    const SwarmSample* below30 = nullptr;
+    for (const auto& sample : swarmSamples) {
+        peak.balls = std::max(peak.balls, sample.balls);
+        peak.meteors = std::max(peak.meteors, sample.meteors);
+        peak.effects = std::max(peak.effects, sample.effects);
+        peak.particles = std::max(peak.particles, sample.particles);
+        peak.simMs = std::max(peak.simMs, sample.simMs);
+        peak.renderMs = std::max(peak.renderMs, sample.renderMs);
+        if (!below60 && sample.fps < 60.0 && !headless) below60 = &sample;
+        if (!below30 && sample.fps < 30.0 && !headless) below30 = &sample;
+    }
+    fprintf(file, "# swarm targets: balls %d meteors %d effects %d ramp %.0f s%s\n", swarmBalls, swarmMeteors, swarmEffects, swarmRampSeconds, headless ? " (headless)" : "");
+    fprintf(file, "# peak: balls %zu meteors %zu effects %zu particles %d sim %.3f ms render %.3f ms\n",
+        peak.balls, peak.meteors, peak.effects, peak.particles, peak.simMs, peak.renderMs);
+    if (below60) fprintf(file, "# below 60 FPS at %.0f s: balls %zu meteors %zu effects %zu\n", below60->second, below60->balls, below60->meteors, below60->effects);
+    if (below30) fprintf(file, "# below 30 FPS at %.0f s: balls %zu meteors %zu effects %zu\n", below30->second, below30->balls, below30->meteors, below30->effects);
+    fprintf(file, "second,balls,meteors,effects,particles,sim_ms,render_ms,fps\n");
+    for (const auto& sample : swarmSamples) {
+        fprintf(file, "%.1f,%zu,%zu,%zu,%d,%.3f,%.3f,%.1f\n", sample.second, sample.balls, sample.meteors, sample.effects,
+            sample.particles, sample.simMs, sample.renderMs, sample.fps);
+    }
+    fclose(file);
+}
+
+// Bounce effects are collected per chunk while balls move in parallel, then appended in chunk
+// order so the effect list matches a serial update.
+void IntegrateBalls(int begin, int end, int chunk, float dt) {
+    effectSink = &ballChunkEffects[chunk];
+    for (int i = begin; i < end; ++i) AdvanceBall(balls[i], 0.0f, dt, ballPaths[i]);
+    effectSink = nullptr;
+}
+
+void MergeBallEffects(int chunks) {
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        for (const auto& effect : ballChunkEffects[chunk]) SpawnEffect(effect);
+        ballChunkEffects[chunk].clear();
+    }
+}
+
+template <typename Mode>
+void CheckPlayerCollisions() {
+    if (!Mode::lethal || player.isInvisible) return;
+    std::atomic<bool> hit(false);
+    ParallelFor(static_cast<int>(balls.size()), BALL_JOB_GRAIN, [&](int begin, int end, int) {
+        for (int i = begin; i < end && !hit.load(std::memory_order_relaxed); ++i) {
+            if (PlayerTimeOfImpact(ballPaths[i], balls[i].radius) >= 0) hit = true;
+        }
+    });
+    if (hit) KillPlayer(DEATH_BALL);
+}
+
+// Fixed-point mode: every quantity the outcome depends on is an integer (meteor coordinates stay
+// whole numbers, which floats hold exactly), stepped one tick at a time with hits found by overlap
+// at the end of each tick, so the result is the same for any compiler, flags or CPU.
+void StepFixedBall(Ball& ball, float t) {
+    FixedVector& position = ball.fixedPosition;
+    FixedVector& velocity = ball.fixedVelocity;
+    Fixed radius = ToFixed(ball.radius), gravity = ToFixed(GRAVITY);
+    // Exact samples of the ballistic arc, so energy is conserved between bounces.
+    position.x += velocity.x;
+    position.y += velocity.y + gravity / 2;
+    velocity.y += gravity;
+    Fixed floor = ToFixed(FLOOR_Y) - radius, right = ToFixed(static_cast<float>(SCREEN_WIDTH)) - radius;
+    if (position.y > floor && velocity.y > 0) {
+        // Mirror back above the floor with the speed that conserves energy at that height, so the
+        // bounce neither gains nor loses height.
+        long long speedSquared = static_cast<long long>(velocity.y) * velocity.y - 4LL * gravity * (position.y - floor);
+        position.y = 2 * floor - position.y;
+        velocity.y = -FixedSqrt(speedSquared);
+        PushBounceEffect(FromFixed(position.x), FromFixed(floor), ball.radius * 0.8f, t, true);
+    }
+    if (position.x < radius && velocity.x < 0) {
+        position.x = 2 * radius - position.x;
+        velocity.x = -velocity.x;
+        PushBounceEffect(0.0f, FromFixed(position.y), ball.radius * 0.5f, t, true);
+    }
+    else if (position.x > right && velocity.x > 0) {
+        position.x = 2 * right - position.x;
+        velocity.x = -velocity.x;
+        PushBounceEffect(static_cast<float>(SCREEN_WIDTH), FromFixed(position.y), ball.radius * 0.5f, t, true);
+    }
+    ball.position = FromFixed(position);
+    ball.velocity = FromFixed(velocity);
+}
+
+template <typename Mode>
+void StepFixedMeteors(float t) {
+    Archetype& meteors = MeteorArchetype();
+    meteorImpacts = ArenaAlloc<char>(meteors.count);
+    for (int row = 0; row < meteors.count; ++row) {
+        MeteorState& meteor = RowComponent<MeteorState>(meteors, row);
+        Vector2& position = RowComponent<Position>(meteors, row).value;
+        meteorImpacts[row] = 0;
+        if (meteor.hasExploded) continue;
+        position.y = std::min(position.y + METEOR_FALL_SPEED, FLOOR_Y);
+        if (position.y < FLOOR_Y) continue;
+        meteor.hasExploded = true;
+        RowComponent<Lifetime>(meteors, row).startTime = StepTime(t);
+        meteorImpacts[row] = 1;
+    }
+    ResolveMeteors<Mode>();
+}
+
+// Lowest-index ball the shot overlaps, else a falling meteor (encoded below NO_TARGET), else NO_TARGET.
+// A beam covers its column from the tip down to the player.
+int FixedShotTarget(const Projectile& shot) {
+    Fixed playerY = ToFixed(player.position.y), bolt = ToFixed(BOLT_RADIUS);
+    auto hits = [&](FixedVector center, Fixed radius) {
+        if (!shot.isBeam) return FixedOverlap(center, shot.fixedPosition, radius + bolt);
+        return abs(center.x - shot.fixedPosition.x) < radius && center.y < playerY && center.y > shot.fixedPosition.y - radius;
+    };
+    for (size_t i = 0; i < balls.size(); ++i) {
+        if (hits(balls[i].fixedPosition, ToFixed(balls[i].radius))) return static_cast<int>(i);
+    }
+    Archetype& meteors = MeteorArchetype();
+    for (int row = 0; row < meteors.count; ++row) {
+        if (RowComponent<MeteorState>(meteors, row).hasExploded) continue;
+        if (hits(ToFixed(RowComponent<Position>(meteors, row).value), ToFixed(METEOR_HIT_RADIUS))) return NO_TARGET - 1 - row;
+    }
+    return NO_TARGET;
+}
+
+template <typename Mode>
+void StepFixedProjectiles(float t) {
+    for (int p = 0; p < projectileCount; ++p) {
+        Projectile& shot = projectiles[p];
+        shot.fixedPosition.x += shot.fixedVelocity.x;
+        shot.fixedPosition.y += shot.fixedVelocity.y;
+        shot.position = FromFixed(shot.fixedPosition);
+        if (shot.isBeam) shot.position.x = shot.startX;
+        int target = FixedShotTarget(shot);
+        if (target == NO_TARGET) continue;
+        EmitTelemetry(TELEMETRY_SHOT_HIT, shot.weapon, shot.position.x, shot.position.y, target >= 0 ? balls[target].radius : 0.0f);
+        if (target >= 0) {
+            BubbleEffect effect = { balls[target].position, balls[target].radius, BUBBLE_EFFECT_POP, StepTime(t) };
+            SpawnEffect(effect);
+            EmitParticles(shot.position, 4.0f, 6.0f, POP_PARTICLES, 0.4f, 1.0f, 0.4f);
+            SplitBall<Mode>(target);
+        }
+        else {
+            Archetype& meteors = MeteorArchetype();
+            int row = NO_TARGET - 1 - target;
+            Vector2 position = RowComponent<Position>(meteors, row).value;
+            RowComponent<MeteorState>(meteors, row).hasExploded = true;
+            StartLifetime(RowComponent<Lifetime>(meteors, row), StepTime(t), METEOR_EXPLOSION_MS);
+            EmitParticles(position, 10.0f, 8.0f, METEOR_PARTICLES / 2, 1.0f, 0.5f, 0.1f);
+            EmitTelemetry(TELEMETRY_METEOR_EXPLODE, 1, position.x, position.y, 0.0f);
+            QueueSound(SOUND_METEOR, position.x, 0.7f);
+        }
+        if (shot.isBeam || shot.pierce == 0) shot.isActive = false;
+        else --shot.pierce;
+    }
+    int kept = 0;
+    for (int p = 0; p < projectileCount; ++p) {
+        const Projectile& shot = projectiles[p];
+        if (!shot.isActive || shot.position.y < (shot.isBeam ? 0 : -10) || shot.position.x < -10 || shot.position.x > SCREEN_WIDTH + 10) continue;
+        projectiles[kept++] = shot;
+    }
+    projectileCount = kept;
+}
+
+template <typename Mode>
+void UpdateFixedPoint(int ticks) {
+    for (int tick = 1; tick <= ticks; ++tick) {
+        float t = static_cast<float>(tick);
+        if (Mode::meteors) StepFixedMeteors<Mode>(t);
+        for (auto& ball : balls) StepFixedBall(ball, t);
+        StepFixedProjectiles<Mode>(t);
+        if (!Mode::lethal || player.isInvisible) continue;
+        FixedVector center = ToFixed(player.position);
+        for (const auto& ball : balls) {
+            if (FixedOverlap(ball.fixedPosition, center, ToFixed(ball.radius + player.width / 2))) {
+                KillPlayer(DEATH_BALL);
+                break;
+            }
+        }
+    }
+}
+
+// Meteor motion and ball integration are independent and run side by side. Meteor impacts resolve
+// first (as in a serial update), then the collision phase needs every ball path.
+template <typename Mode>
+void UpdatePhysics(float dt) {
+    std::atomic<int> meteorPhase(0), ballPhase(0);
+    auto moveMeteors = [dt](int begin, int end, int) { MoveMeteors(begin, end, dt); };
+    if (Mode::meteors) {
+        Archetype& meteors = MeteorArchetype();
+        meteorImpacts = ArenaAlloc<char>(meteors.count);
+        SubmitParallelFor(meteorPhase, (meteors.count + meteors.capacity - 1) / meteors.capacity, 1, moveMeteors);
+    }
+    int ballChunks = eventPhysics ? 0 : JobChunks(static_cast<int>(balls.size()), BALL_JOB_GRAIN);
+    auto integrateBalls = [dt](int begin, int end, int chunk) { IntegrateBalls(begin, end, chunk, dt); };
+    if (!eventPhysics) {
+        ballPaths.resize(balls.size());
+        if (static_cast<int>(ballChunkEffects.size()) < ballChunks) ballChunkEffects.resize(ballChunks);
+        SubmitParallelFor(ballPhase, static_cast<int>(balls.size()), BALL_JOB_GRAIN, integrateBalls);
+    }
+    if (Mode::meteors) {
+        WaitForJobs(meteorPhase);
+        ResolveMeteors<Mode>();
+    }
+    WaitForJobs(ballPhase);
+    if (eventPhysics) {
+        UpdateBallsEventDriven<Mode>(dt);
+    }
+    else {
+        MergeBallEffects(ballChunks);
+        UpdateProjectiles<Mode>(dt);
+        CheckPlayerCollisions<Mode>();
+    }
+    MoveProjectiles(dt);
+}
+
+template <typename Mode>
+void UpdateGameMode() {
+    float dt = static_cast<float>(simStepTicks);
+    stepStartTime = simTime;
+    simTime += SIM_TICK_MS * simStepTicks;
+    ArenaReset();
+    if (Mode::meteors && meteorDropTimer < 0) {
+        meteorDropTimer = ScheduleTimer(lastMeteorDropTime / SIM_TICK_MS + static_cast<int>(Mode::meteorInterval) / SIM_TICK_MS + 1, TIMER_METEOR_DROP);
+    }
+    int fired = AdvanceTimers(SimTick());
+    if (fired & 1 << TIMER_INVISIBILITY) player.isInvisible = false;
+    if (fired & 1 << TIMER_EXPIRY_SWEEP) SweepExpired(world);
+    if (fired & 1 << TIMER_SCORE) UpdateScore<Mode>();
+    if (Mode::meteors && (fired & 1 << TIMER_METEOR_DROP)) DropMeteor();
+    if (swarmMode) UpdateSwarm();
+    if (fixedPoint) UpdateFixedPoint<Mode>(simStepTicks);
+    else UpdatePhysics<Mode>(dt);
+    if (!headless) RecordBallTrails();
+}
+
+// FNV-1a over the 32-bit words of value.
+template <typename T>
+unsigned HashValue(unsigned hash, const T& value) {
+    static_assert(sizeof(T) % 4 == 0, "hash whole words");
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for (size_t i = 0; i < sizeof(T); i += 4) {
+        unsigned word;
+        memcpy(&word, bytes + i, 4);
+        hash = (hash ^ word) * 16777619u;
     }
+    return hash;
 }
 
-void UpdateGame() {
-    UpdateInvisibilityStatus();
-    UpdateBubbleEffects();
-    if (!gameOver) {
-        UpdateScore();
-        if (GetTime() - lastMeteorDropTime > METEOR_DROP_INTERVAL) DropMeteor();
-    }
-    UpdateMeteors();
-
-    for (size_t i = 0; i < balls.size();) {
-        bool wasMovingDown = balls[i].velocity.y > 0;
-        balls[i].velocity.y += GRAVITY;
-        balls[i].position.x += balls[i].velocity.x;
-        balls[i].position.y += balls[i].velocity.y;
-
-        if (balls[i].position.y + balls[i].radius > SCREEN_HEIGHT - 10) {
-            balls[i].position.y = SCREEN_HEIGHT - 10 - balls[i].radius;
-            balls[i].velocity.y *= -BALL_BOUNCE_FACTOR;
-            if (wasMovingDown) {
-                BubbleEffect effect = { balls[i].position, balls[i].radius * 0.8f, BUBBLE_EFFECT_BOUNCE, GetTime(), 1.0f };
-                bubbleEffects.push_back(effect);
-            }
-        }
-        if (balls[i].position.x - balls[i].radius < 0) {
-            balls[i].position.x = balls[i].radius;
-            balls[i].velocity.x *= -1.0f;
-            BubbleEffect effect = { {balls[i].position.x - balls[i].radius, balls[i].position.y}, balls[i].radius * 0.5f, BUBBLE_EFFECT_BOUNCE, GetTime(), 1.0f };
-            bubbleEffects.push_back(effect);
-        }
-        if (balls[i].position.x + balls[i].radius > SCREEN_WIDTH) {
-            balls[i].position.x = SCREEN_WIDTH - balls[i].radius;
-            balls[i].velocity.x *= -1.0f;
-            BubbleEffect effect = { {balls[i].position.x + balls[i].radius, balls[i].position.y}, balls[i].radius * 0.5f, BUBBLE_EFFECT_BOUNCE, GetTime(), 1.0f };
-            bubbleEffects.push_back(effect);
-        }
-        if (!player.isInvisible) {
-            float dist = sqrt(pow(balls[i].position.x - player.position.x, 2) + pow(balls[i].position.y - player.position.y, 2));
-            if (dist < balls[i].radius + player.width / 2) {
-                gameOver = true;
-                SaveHighScore();
-                break;
-            }
-        }
-        ++i;
+// Chains the state after a step onto hash. The fixed-point mode hashes its integer state, which is
+// the same on every machine; otherwise float bits only match on the same build and CPU.
+unsigned HashState(unsigned hash) {
+    hash = HashValue(hash, score);
+    hash = HashValue(hash, static_cast<int>(gameOver) | static_cast<int>(player.isInvisible) << 1);
+    hash = HashValue(hash, player.position);
+    for (const auto& ball : balls) {
+        hash = fixedPoint ? HashValue(HashValue(hash, ball.fixedPosition), ball.fixedVelocity) : HashValue(HashValue(hash, ball.position), ball.velocity);
+        hash = HashValue(hash, ball.radius);
     }
-
-    if (laser.isActive) {
-        laser.position.y -= LASER_SPEED;
-        if (laser.position.y < 0) laser.isActive = false;
-        for (size_t i = 0; i < balls.size(); ++i) {
-            if (CheckLaserCollision(balls[i])) {
-                BubbleEffect effect = { balls[i].position, balls[i].radius, BUBBLE_EFFECT_POP, GetTime(), 1.0f };
-                bubbleEffects.push_back(effect);
-                SplitBall(i);
-                laser.isActive = false;
-                break;
-            }
-        }
+    ForEachEntity<Position, MeteorState>(world, [&hash](const Position& position, const MeteorState& meteor) {
+        hash = HashValue(HashValue(hash, position.value), static_cast<int>(meteor.hasExploded));
+    });
+    for (int p = 0; p < projectileCount; ++p) {
+        hash = fixedPoint ? HashValue(hash, projectiles[p].fixedPosition) : HashValue(hash, projectiles[p].position);
     }
+    return hash;
 }
 
-void RenderMeteors() {
-    for (const auto& meteor : meteors) {
+void UpdateGame() {
+    GAME_MODES[gameMode].update();
+    stateHash = HashState(stateHash);
+}
+
+void RenderMeteors(const GameSnapshot& snapshot) {
+    ForEachEntity<Position, MeteorState, Lifetime>(snapshot.world, [&](const Position& position, const MeteorState& meteor, const Lifetime& lifetime) {
         if (!meteor.hasExploded) {
-            RenderTexture(meteorTexture, meteor.position.x, meteor.position.y, 40, 40, 1.0f);
+            RenderTexture(meteorTexture, position.value.x, position.value.y, 40, 40, 1.0f);
         }
         else {
-            float progress = (GetTime() - meteor.explosionStartTime) / 1000.0f;
+            float progress = (snapshot.simTime - lifetime.startTime) / static_cast<float>(METEOR_EXPLOSION_MS);
             if (progress < 1.0f) {
                 float radius = METEOR_EXPLOSION_RADIUS * progress;
-                RenderShape(meteor.position.x, meteor.position.y, radius, radius, 1.0f, 0.3f, 0.1f, (1.0f - progress) * 0.7f, true);
-                BubbleEffect effect = { meteor.position, radius, BUBBLE_EFFECT_POP, GetTime(), 1.0f };
-                bubbleEffects.push_back(effect);
+                RenderShape(position.value.x, position.value.y, radius, radius, 1.0f, 0.3f, 0.1f, (1.0f - progress) * 0.7f, true);
             }
         }
-    }
+    });
 }
 
-void RenderUI() {
+// One batched draw for every live particle.
+void RenderParticles() {
+    int n = particles.count;
+    if (n == 0) return;
+    BuildParticleVertices(n, particles.x.data(), particles.y.data(), particles.r.data(), particles.g.data(), particles.b.data(),
+        particles.life.data(), particles.vertices.data(), particles.colors.data());
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    SetPointSize(2.0f);
+    EnableArray(GL_VERTEX_ARRAY);
+    EnableArray(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, particles.vertices.data());
+    glColorPointer(4, GL_FLOAT, 0, particles.colors.data());
+    DrawArrays(GL_POINTS, 0, n);
+    DisableArray(GL_COLOR_ARRAY);
+    DisableArray(GL_VERTEX_ARRAY);
+    SetPointSize(1.0f);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    DisableState(GL_BLEND);
+}
+
+void RenderUI(const GameSnapshot& snapshot) {
     char buffer[128];
-    RenderShape(SCREEN_WIDTH - 110, 35, 200, 50, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    RenderShape(SCREEN_WIDTH - 110, 42, 200, 64, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glColor4f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2], 0.7f);
-    glLineWidth(2.0f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(SCREEN_WIDTH - 210, 10);
-    glVertex2f(SCREEN_WIDTH - 10, 10);
-    glVertex2f(SCREEN_WIDTH - 10, 60);
-    glVertex2f(SCREEN_WIDTH - 210, 60);
+    SetLineWidth(2.0f);
+    BeginBatch(GL_LINE_LOOP);
+    BatchVertex(SCREEN_WIDTH - 210, 10);
+    BatchVertex(SCREEN_WIDTH - 10, 10);
+    BatchVertex(SCREEN_WIDTH - 10, 74);
+    BatchVertex(SCREEN_WIDTH - 210, 74);
     glEnd();
-    glLineWidth(1.0f);
-    glDisable(GL_BLEND);
+    SetLineWidth(1.0f);
+    DisableState(GL_BLEND);
 
     glColor3f(UI_TEXT_COLOR[0], UI_TEXT_COLOR[1], UI_TEXT_COLOR[2]);
     glRasterPos2f(SCREEN_WIDTH - 190, 35);
-    snprintf(buffer, sizeof(buffer), "SCORE: %d", score);
-    for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
+    snprintf(buffer, sizeof(buffer), "SCORE: %d", snapshot.score);
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_18, *c);
     glRasterPos2f(SCREEN_WIDTH - 190, 50);
-    snprintf(buffer, sizeof(buffer), "HIGH SCORE: %d", highScore);
-    for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    snprintf(buffer, sizeof(buffer), "HIGH SCORE: %d", snapshot.highScore);
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    glRasterPos2f(SCREEN_WIDTH - 190, 66);
+    snprintf(buffer, sizeof(buffer), "WEAPON: %s [1-4]", WEAPONS[snapshot.player.weapon].name);
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    if (snapshot.autopilotMs >= 0) {
+        glColor3f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2]);
+        glRasterPos2f(SCREEN_WIDTH - 190, 92);
+        snprintf(buffer, sizeof(buffer), "AUTOPILOT  %.3f ms", snapshot.autopilotMs);
+        for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
 
     RenderShape(105, 55, 190, 90, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glColor4f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2], 0.7f);
-    glLineWidth(2.0f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(10, 10);
-    glVertex2f(200, 10);
-    glVertex2f(200, 100);
-    glVertex2f(10, 100);
+    SetLineWidth(2.0f);
+    BeginBatch(GL_LINE_LOOP);
+    BatchVertex(10, 10);
+    BatchVertex(200, 10);
+    BatchVertex(200, 100);
+    BatchVertex(10, 100);
     glEnd();
-    glLineWidth(1.0f);
-    glDisable(GL_BLEND);
+    SetLineWidth(1.0f);
+    DisableState(GL_BLEND);
 
-    int pointsToNextBall = ((score / BALL_SPAWN_SCORE_INTERVAL) + 1) * BALL_SPAWN_SCORE_INTERVAL - score;
+    int spawnInterval = GAME_MODES[gameMode].spawnScoreInterval;
+    int pointsToNextBall = ((snapshot.score / spawnInterval) + 1) * spawnInterval - snapshot.score;
     glRasterPos2f(20, 25);
     snprintf(buffer, sizeof(buffer), "NEXT BALL: %d pts", pointsToNextBall);
-    for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-    float nextBallProgress = 1.0f - static_cast<float>(pointsToNextBall) / BALL_SPAWN_SCORE_INTERVAL;
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    float nextBallProgress = 1.0f - static_cast<float>(pointsToNextBall) / spawnInterval;
     RenderShape(105, 40, 150, 10, 0.2f, 0.2f, 0.2f, 0.7f);
     if (nextBallProgress > 0) {
         RenderShape(105 - 75 + 75 * nextBallProgress, 40, 150 * nextBallProgress, 8, 0.9f, 0.6f, 0.1f, 0.9f);
     }
-    glEnable(GL_BLEND);
+    EnableState(GL_BLEND);
     glColor4f(1.0f, 1.0f, 1.0f, 0.7f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(30, 35);
-    glVertex2f(180, 35);
-    glVertex2f(180, 45);
-    glVertex2f(30, 45);
+    BeginBatch(GL_LINE_LOOP);
+    BatchVertex(30, 35);
+    BatchVertex(180, 35);
+    BatchVertex(180, 45);
+    BatchVertex(30, 45);
     glEnd();
-    glDisable(GL_BLEND);
+    DisableState(GL_BLEND);
 
     glRasterPos2f(20, 60);
-    snprintf(buffer, sizeof(buffer), "INVISIBILITY: %d", player.remainingInvisibilityUses);
-    for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-    int pointsToNextReward = ((score / INVISIBILITY_REWARD_INTERVAL) + 1) * INVISIBILITY_REWARD_INTERVAL - score;
+    snprintf(buffer, sizeof(buffer), "INVISIBILITY: %d", snapshot.player.remainingInvisibilityUses);
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    int pointsToNextReward = ((snapshot.score / INVISIBILITY_REWARD_INTERVAL) + 1) * INVISIBILITY_REWARD_INTERVAL - snapshot.score;
     glRasterPos2f(20, 75);
     snprintf(buffer, sizeof(buffer), "NEXT POWER: %d pts", pointsToNextReward);
-    for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
     float invisibilityProgress = 1.0f - static_cast<float>(pointsToNextReward) / INVISIBILITY_REWARD_INTERVAL;
     RenderShape(105, 85, 150, 10, 0.2f, 0.2f, 0.2f, 0.7f);
     if (invisibilityProgress > 0) {
         RenderShape(105 - 75 + 75 * invisibilityProgress, 85, 150 * invisibilityProgress, 8, 0.3f, 0.8f, 1.0f, 0.9f);
     }
-    glEnable(GL_BLEND);
+    EnableState(GL_BLEND);
     glColor4f(1.0f, 1.0f, 1.0f, 0.7f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(30, 80);
-    glVertex2f(180, 80);
-    glVertex2f(180, 90);
-    glVertex2f(30, 90);
+    BeginBatch(GL_LINE_LOOP);
+    BatchVertex(30, 80);
+    BatchVertex(180, 80);
+    BatchVertex(180, 90);
+    BatchVertex(30, 90);
     glEnd();
-    glDisable(GL_BLEND);
+    DisableState(GL_BLEND);
 
-    if (player.isInvisible) {
+    if (snapshot.player.isInvisible) {
         RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT - 40, 300, 30, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
-        glEnable(GL_BLEND);
+        EnableState(GL_BLEND);
         glColor4f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2], 0.7f);
-        glLineWidth(2.0f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT - 55);
-        glVertex2f(SCREEN_WIDTH / 2 + 150, SCREEN_HEIGHT - 55);
-        glVertex2f(SCREEN_WIDTH / 2 + 150, SCREEN_HEIGHT - 25);
-        glVertex2f(SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT - 25);
+        SetLineWidth(2.0f);
+        BeginBatch(GL_LINE_LOOP);
+        BatchVertex(SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT - 55);
+        BatchVertex(SCREEN_WIDTH / 2 + 150, SCREEN_HEIGHT - 55);
+        BatchVertex(SCREEN_WIDTH / 2 + 150, SCREEN_HEIGHT - 25);
+        BatchVertex(SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT - 25);
         glEnd();
-        glLineWidth(1.0f);
-        glDisable(GL_BLEND);
-        int timeLeft = INVISIBILITY_DURATION - (GetTime() - player.invisibilityStartTime);
+        SetLineWidth(1.0f);
+        DisableState(GL_BLEND);
+        int timeLeft = INVISIBILITY_DURATION - (snapshot.simTime - snapshot.player.invisibilityStartTime);
         glRasterPos2f(SCREEN_WIDTH / 2 - 140, SCREEN_HEIGHT - 45);
         snprintf(buffer, sizeof(buffer), "INVISIBILITY: %.1f SEC", timeLeft / 1000.0f);
-        for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+        for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
         float timePercentage = static_cast<float>(timeLeft) / INVISIBILITY_DURATION;
         RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT - 35, 240, 10, 0.2f, 0.2f, 0.2f, 0.7f);
         if (timePercentage > 0) {
             RenderShape(SCREEN_WIDTH / 2 - 120 + 120 * timePercentage, SCREEN_HEIGHT - 35, 240 * timePercentage, 8, 0.3f, 0.9f, 1.0f, 0.9f);
         }
-        glEnable(GL_BLEND);
+        EnableState(GL_BLEND);
         glColor4f(1.0f, 1.0f, 1.0f, 0.7f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT - 40);
-        glVertex2f(SCREEN_WIDTH / 2 + 120, SCREEN_HEIGHT - 40);
-        glVertex2f(SCREEN_WIDTH / 2 + 120, SCREEN_HEIGHT - 30);
-        glVertex2f(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT - 30);
+        BeginBatch(GL_LINE_LOOP);
+        BatchVertex(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT - 40);
+        BatchVertex(SCREEN_WIDTH / 2 + 120, SCREEN_HEIGHT - 40);
+        BatchVertex(SCREEN_WIDTH / 2 + 120, SCREEN_HEIGHT - 30);
+        BatchVertex(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT - 30);
         glEnd();
-        glDisable(GL_BLEND);
+        DisableState(GL_BLEND);
     }
 
     RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT - 15, 500, 20, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
-    glEnable(GL_BLEND);
+    EnableState(GL_BLEND);
     glColor4f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2], 0.7f);
-    glLineWidth(2.0f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT - 25);
-    glVertex2f(SCREEN_WIDTH / 2 + 250, SCREEN_HEIGHT - 25);
-    glVertex2f(SCREEN_WIDTH / 2 + 250, SCREEN_HEIGHT - 5);
-    glVertex2f(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT - 5);
+    SetLineWidth(2.0f);
+    BeginBatch(GL_LINE_LOOP);
+    BatchVertex(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT - 25);
+    BatchVertex(SCREEN_WIDTH / 2 + 250, SCREEN_HEIGHT - 25);
+    BatchVertex(SCREEN_WIDTH / 2 + 250, SCREEN_HEIGHT - 5);
+    BatchVertex(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT - 5);
     glEnd();
-    glLineWidth(1.0f);
-    glDisable(GL_BLEND);
-    glRasterPos2f(SCREEN_WIDTH / 2 - 175, SCREEN_HEIGHT - 10);
-    const char* controlText = "LEFT/RIGHT: Move | SPACE: Shoot | I: Invisibility | R: Restart";
-    for (const char* c = controlText; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    SetLineWidth(1.0f);
+    DisableState(GL_BLEND);
+    glRasterPos2f(SCREEN_WIDTH / 2 - 205, SCREEN_HEIGHT - 10);
+    const char* controlText = "LEFT/RIGHT: Move | SPACE: Shoot | I: Invisibility | P: Pause | R: Restart";
+    for (const char* c = controlText; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
 
-    if (gameOver) {
+    if (snapshot.gameOver) {
         RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT, 0.0f, 0.0f, 0.0f, 0.7f);
         RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, 350, 200, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
-        glEnable(GL_BLEND);
+        EnableState(GL_BLEND);
         glColor4f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2], 0.7f);
-        glLineWidth(2.0f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(SCREEN_WIDTH / 2 - 175, SCREEN_HEIGHT / 2 - 100);
-        glVertex2f(SCREEN_WIDTH / 2 + 175, SCREEN_HEIGHT / 2 - 100);
-        glVertex2f(SCREEN_WIDTH / 2 + 175, SCREEN_HEIGHT / 2 + 100);
-        glVertex2f(SCREEN_WIDTH / 2 - 175, SCREEN_HEIGHT / 2 + 100);
+        SetLineWidth(2.0f);
+        BeginBatch(GL_LINE_LOOP);
+        BatchVertex(SCREEN_WIDTH / 2 - 175, SCREEN_HEIGHT / 2 - 100);
+        BatchVertex(SCREEN_WIDTH / 2 + 175, SCREEN_HEIGHT / 2 - 100);
+        BatchVertex(SCREEN_WIDTH / 2 + 175, SCREEN_HEIGHT / 2 + 100);
+        BatchVertex(SCREEN_WIDTH / 2 - 175, SCREEN_HEIGHT / 2 + 100);
         glEnd();
-        glLineWidth(1.0f);
-        glDisable(GL_BLEND);
+        SetLineWidth(1.0f);
+        DisableState(GL_BLEND);
         glColor3f(1.0f, 0.3f, 0.3f);
         glRasterPos2f(SCREEN_WIDTH / 2 - 60, SCREEN_HEIGHT / 2 - 70);
         const char* gameOverText = "GAME OVER";
-        for (const char* c = gameOverText; *c; c++) glutBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, *c);
+        for (const char* c = gameOverText; *c; c++) DrawCharacter(GLUT_BITMAP_TIMES_ROMAN_24, *c);
         glColor3f(UI_TEXT_COLOR[0], UI_TEXT_COLOR[1], UI_TEXT_COLOR[2]);
         glRasterPos2f(SCREEN_WIDTH / 2 - 70, SCREEN_HEIGHT / 2 - 20);
-        snprintf(buffer, sizeof(buffer), "FINAL SCORE: %d", score);
-        for (char* c = buffer; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-        if (score >= highScore && score > 0) {
+        snprintf(buffer, sizeof(buffer), "FINAL SCORE: %d", snapshot.score);
+        for (char* c = buffer; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_18, *c);
+        if (snapshot.score >= snapshot.highScore && snapshot.score > 0) {
             glColor3f(1.0f, 1.0f, 0.0f);
             glRasterPos2f(SCREEN_WIDTH / 2 - 120, SCREEN_HEIGHT / 2 + 10);
             const char* highScoreText = "NEW HIGH SCORE ACHIEVED!";
-            for (const char* c = highScoreText; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
+            for (const char* c = highScoreText; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_18, *c);
         }
         glColor3f(UI_TEXT_COLOR[0], UI_TEXT_COLOR[1], UI_TEXT_COLOR[2]);
         glRasterPos2f(SCREEN_WIDTH / 2 - 70, SCREEN_HEIGHT / 2 + 50);
         const char* restartText = "Press 'R' to restart";
-        for (const char* c = restartText; *c; c++) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+        for (const char* c = restartText; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+    else if (snapshot.paused) {
+        RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT, 0.0f, 0.0f, 0.0f, 0.5f);
+        glColor3f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2]);
+        glRasterPos2f(SCREEN_WIDTH / 2 - 45, SCREEN_HEIGHT / 2 - 10);
+        const char* pausedText = "PAUSED";
+        for (const char* c = pausedText; *c; c++) DrawCharacter(GLUT_BITMAP_TIMES_ROMAN_24, *c);
+        glColor3f(UI_TEXT_COLOR[0], UI_TEXT_COLOR[1], UI_TEXT_COLOR[2]);
+        glRasterPos2f(SCREEN_WIDTH / 2 - 60, SCREEN_HEIGHT / 2 + 20);
+        const char* resumeText = "Press 'P' to resume";
+        for (const char* c = resumeText; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+}
+
+void RenderSwarmOverlay(const GameSnapshot& snapshot) {
+    char lines[4][128];
+    snprintf(lines[0], sizeof(lines[0]), "SWARM  FPS %.1f  SCALE %.2f", swarmCurrent.fps, renderScale);
+    snprintf(lines[1], sizeof(lines[1]), "SIM %.2f ms   RENDER %.2f ms", swarmCurrent.simMs, swarmCurrent.renderMs);
+    snprintf(lines[2], sizeof(lines[2]), "BALLS %zu  METEORS %zu", snapshot.balls.size(), EntityCount<MeteorState>(snapshot.world));
+    snprintf(lines[3], sizeof(lines[3]), "EFFECTS %zu  PARTICLES %d  SHOTS %d", EntityCount<EffectShape>(snapshot.world), particles.count, snapshot.projectileCount);
+    RenderShape(SCREEN_WIDTH / 2, 50, 300, 80, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
+    glColor3f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2]);
+    for (int i = 0; i < 4; ++i) {
+        glRasterPos2f(SCREEN_WIDTH / 2 - 140, 25 + i * 17);
+        for (char* c = lines[i]; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+}
+
+// Toggled with F3: the governor's view of the frame and what the current tier draws.
+void RenderDebugOverlay(const GameSnapshot& snapshot) {
+    const QualityTier& quality = QUALITY_TIERS[qualityTier];
+    size_t effects = EntityCount<EffectShape>(snapshot.world);
+    char lines[3][128];
+    snprintf(lines[0], sizeof(lines[0]), "QUALITY %s%s  SCALE %.2f", quality.name, adaptiveQuality ? " (auto)" : "", renderScale);
+    snprintf(lines[1], sizeof(lines[1]), "RENDER %.2f ms  BUDGET %.1f ms", renderMsAverage, frameBudgetMs);
+    snprintf(lines[2], sizeof(lines[2]), "TRAIL %d  EFFECTS %zu/%zu  GLOW %s", std::min(trailLength, quality.trailLength),
+        std::min(effects, static_cast<size_t>(quality.maxEffects)), effects, quality.glow ? "ON" : "OFF");
+    RenderShape(130, SCREEN_HEIGHT - 70, 240, 64, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
+    glColor3f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2]);
+    for (int i = 0; i < 3; ++i) {
+        glRasterPos2f(18, SCREEN_HEIGHT - 86 + i * 17);
+        for (char* c = lines[i]; *c; c++) DrawCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+    }
+}
+
+// Toggled with F4: the last finished frame's GL work per subsystem.
+void RenderStatsOverlay() {
+    char line[128];
+    RenderCounters total = {};
+    RenderShape(SCREEN_WIDTH - 165, SCREEN_HEIGHT - 130, 310, 198, UI_PANEL_COLOR[0], UI_PANEL_COLOR[1], UI_PANEL_COLOR[2], UI_PANEL_COLOR[3]);
+    glColor3f(UI_HIGHLIGHT_COLOR[0], UI_HIGHLIGHT_COLOR[1], UI_HIGHLIGHT_COLOR[2]);
+    for (int i = -1; i <= RENDER_SUBSYSTEM_COUNT; ++i) {
+        if (i < 0) snprintf(line, sizeof(line), "%-12s %5s %7s %4s %5s", "", "DRAWS", "VERTS", "TEX", "STATE");
+        else {
+            const RenderCounters& counters = i < RENDER_SUBSYSTEM_COUNT ? lastRenderCounters[i] : total;
+            snprintf(line, sizeof(line), "%-12s %5d %7d %4d %5d", i < RENDER_SUBSYSTEM_COUNT ? RENDER_SUBSYSTEM_NAMES[i] : "total",
+                counters.drawCalls, counters.vertices, counters.textureBinds, counters.stateChanges);
+            if (i < RENDER_SUBSYSTEM_COUNT) {
+                total.drawCalls += counters.drawCalls;
+                total.vertices += counters.vertices;
+                total.textureBinds += counters.textureBinds;
+                total.stateChanges += counters.stateChanges;
+            }
+        }
+        glRasterPos2f(SCREEN_WIDTH - 312, SCREEN_HEIGHT - 216 + (i + 1) * 16);
+        for (char* c = line; *c; c++) DrawCharacter(GLUT_BITMAP_8_BY_13, *c);
+    }
+}
+
+// Keeps the finished frame's counters for the overlay, appends them to the CSV and starts the next.
+void FinishRenderStats() {
+    if (renderStatsOut) {
+        for (int i = 0; i < RENDER_SUBSYSTEM_COUNT; ++i) {
+            const RenderCounters& counters = renderCounters[i];
+            fprintf(renderStatsOut, "%lld,%s,%d,%d,%d,%d\n", renderFrame, RENDER_SUBSYSTEM_NAMES[i],
+                counters.drawCalls, counters.vertices, counters.textureBinds, counters.stateChanges);
+        }
+    }
+    std::copy(renderCounters, renderCounters + RENDER_SUBSYSTEM_COUNT, lastRenderCounters);
+    std::fill(renderCounters, renderCounters + RENDER_SUBSYSTEM_COUNT, RenderCounters{});
+    renderSubsystem = RENDER_FRAME;
+    ++renderFrame;
+}
+
+void StartRenderStats() {
+    if (!renderStatsFile) return;
+#ifdef _MSC_VER
+    if (fopen_s(&renderStatsOut, renderStatsFile, "w") != 0) renderStatsOut = nullptr;
+#else
+    renderStatsOut = fopen(renderStatsFile, "w");
+#endif
+    if (!renderStatsOut) {
+        std::cerr << "Failed to open render stats file: " << renderStatsFile << std::endl;
+        return;
+    }
+    fprintf(renderStatsOut, "frame,subsystem,draw_calls,vertices,texture_binds,state_changes\n");
+}
+
+void StopRenderStats() {
+    if (!renderStatsOut) return;
+    fclose(renderStatsOut);
+    renderStatsOut = nullptr;
+}
+
+// Every beam and bolt in one line batch.
+void RenderProjectiles(const GameSnapshot& snapshot) {
+    if (snapshot.projectileCount == 0) return;
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    SetLineWidth(3.0f);
+    BeginBatch(GL_LINES);
+    for (int i = 0; i < snapshot.projectileCount; ++i) {
+        const Projectile& shot = snapshot.projectiles[i];
+        const float* color = WEAPONS[shot.weapon].color;
+        glColor4f(color[0], color[1], color[2], 1.0f);
+        if (shot.isBeam) {
+            BatchVertex(shot.startX, snapshot.player.position.y - snapshot.player.height / 2); // Start from the center of the UFO
+            BatchVertex(shot.startX, shot.position.y);
+        }
+        else {
+            BatchVertex(shot.position.x, shot.position.y);
+            BatchVertex(shot.position.x - shot.velocity.x * 0.8f, shot.position.y - shot.velocity.y * 0.8f);
+        }
     }
+    glEnd();
+    SetLineWidth(1.0f);
+    DisableState(GL_BLEND);
 }
 
-void RenderGame() {
-    glClear(GL_COLOR_BUFFER_BIT);
-    glClearColor(BG_COLOR[0], BG_COLOR[1], BG_COLOR[2], 1.0f);
+void RenderStaticLayers() {
     RenderTexture(backgroundTexture, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f);
     RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT - 5, SCREEN_WIDTH, 10, GROUND_COLOR[0], GROUND_COLOR[1], GROUND_COLOR[2], 1.0f);
     RenderShape(SCREEN_WIDTH / 2, SCREEN_HEIGHT - 10, SCREEN_WIDTH, 5, GROUND_COLOR[0] * 0.7f, GROUND_COLOR[1] * 0.7f, GROUND_COLOR[2] * 0.7f, 1.0f);
-    RenderPlayer();
-    for (const auto& ball : balls) RenderBubbleTrail(ball);
-    for (const auto& effect : bubbleEffects) RenderBubbleEffect(effect);
-    for (const auto& ball : balls) {
+}
+
+void RenderWorld(const GameSnapshot& snapshot) {
+    const QualityTier& quality = QUALITY_TIERS[qualityTier];
+    renderSubsystem = RENDER_PLAYER;
+    RenderPlayer(snapshot.player);
+    renderSubsystem = RENDER_TRAILS;
+    RenderBubbleTrails(snapshot.balls);
+    renderSubsystem = RENDER_EFFECTS;
+    // Effects are stored oldest first; over the tier's cap the oldest, most faded ones are skipped.
+    long long skipEffects = static_cast<long long>(EntityCount<EffectShape>(snapshot.world)) - quality.maxEffects;
+    ForEachEntity<Position, EffectShape, Lifetime>(snapshot.world, [&](const Position& position, const EffectShape& effect, const Lifetime& lifetime) {
+        if (skipEffects-- > 0) return;
+        RenderBubbleEffect(position.value, effect, lifetime.startTime, snapshot.simTime);
+    });
+    renderSubsystem = RENDER_BALLS;
+    for (const auto& ball : snapshot.balls) {
+        if (useShaders) {
+            PushSdfQuad(ball.position.x, ball.position.y, ball.radius, quality.glow ? SDF_BALL : SDF_DISC, 0.6f, 1.0f, 0.6f, 0.7f);
+            continue;
+        }
         RenderShape(ball.position.x, ball.position.y, ball.radius, ball.radius, 0.6f, 1.0f, 0.6f, 0.7f, true);
-        RenderShape(ball.position.x - ball.radius * 0.3f, ball.position.y - ball.radius * 0.3f, ball.radius * 0.3f, ball.radius * 0.3f, 1.0f, 1.0f, 1.0f, 0.3f, true);
-    }
-    RenderMeteors();
-    if (laser.isActive) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glLineWidth(3.0f);
-        glBegin(GL_LINES);
-        glColor4f(0.0f, 1.0f, 0.0f, 1.0f); // Green laser
-        glVertex2f(laser.startX, player.position.y - player.height / 2); // Start from the center of the UFO
-        glVertex2f(laser.startX, laser.position.y);
-        glEnd();
-        glLineWidth(1.0f);
-        glDisable(GL_BLEND);
+        if (quality.glow) RenderShape(ball.position.x - ball.radius * 0.3f, ball.position.y - ball.radius * 0.3f, ball.radius * 0.3f, ball.radius * 0.3f, 1.0f, 1.0f, 1.0f, 0.3f, true);
     }
-    RenderUI();
+    if (useShaders) FlushSdfQuads();
+    renderSubsystem = RENDER_METEORS;
+    RenderMeteors(snapshot);
+    renderSubsystem = RENDER_PARTICLES;
+    RenderParticles();
+    renderSubsystem = RENDER_PROJECTILES;
+    RenderProjectiles(snapshot);
+    renderSubsystem = RENDER_FRAME;
 }
 
-void Display() {
+int NextPowerOfTwo(int n) {
+    int p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Binds texture, first growing it to hold a width x height copy of the screen; its size is rounded
+// up to powers of two for old drivers.
+void EnsureScreenTexture(GLuint& texture, int& textureWidth, int& textureHeight, int width, int height, GLint filter) {
+    if (!texture) glGenTextures(1, &texture);
+    BindTexture(texture);
+    if (width <= textureWidth && height <= textureHeight) return;
+    textureWidth = NextPowerOfTwo(width);
+    textureHeight = NextPowerOfTwo(height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, textureWidth, textureHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+}
+
+// Draws a width x height screen copy over the whole playfield as an opaque replace, with no blending.
+void DrawScreenTexture(GLuint texture, int textureWidth, int textureHeight, int width, int height) {
+    float u = static_cast<float>(width) / textureWidth, v = static_cast<float>(height) / textureHeight;
+    DisableState(GL_BLEND);
+    EnableState(GL_TEXTURE_2D);
+    BindTexture(texture);
+    SetTextureMode(GL_REPLACE);
+    BeginBatch(GL_QUADS);
+    glTexCoord2f(0, v); BatchVertex(0, 0);
+    glTexCoord2f(u, v); BatchVertex(SCREEN_WIDTH, 0);
+    glTexCoord2f(u, 0); BatchVertex(SCREEN_WIDTH, SCREEN_HEIGHT);
+    glTexCoord2f(0, 0); BatchVertex(0, SCREEN_HEIGHT);
+    glEnd();
+    SetTextureMode(GL_MODULATE);
+    DisableState(GL_TEXTURE_2D);
+}
+
+// The background and ground never change, so they are drawn once per view size and captured into
+// an opaque texture; after that each frame starts with a plain copy instead of a clear plus a
+// blended full-screen quad. The capture is at view resolution and sampled with linear filtering,
+// so render scale changes reuse it. Expects the viewport to be the scene at (x, y).
+void DrawStaticLayers(int x, int y, int width, int height) {
+    if (viewWidth != staticLayerWidth || viewHeight != staticLayerHeight) {
+        glViewport(x, y, viewWidth, viewHeight);
+        glScissor(x, y, viewWidth, viewHeight);
+        EnableState(GL_SCISSOR_TEST);
+        glClearColor(BG_COLOR[0], BG_COLOR[1], BG_COLOR[2], 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        RecordDraw(0);
+        DisableState(GL_SCISSOR_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        RenderStaticLayers();
+        EnsureScreenTexture(staticLayerTexture, staticTextureWidth, staticTextureHeight, viewWidth, viewHeight, GL_LINEAR);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, viewWidth, viewHeight);
+        RecordDraw(0);
+        staticLayerWidth = viewWidth;
+        staticLayerHeight = viewHeight;
+        glViewport(x, y, width, height);
+        if (width == viewWidth && height == viewHeight) return;
+    }
+    DrawScreenTexture(staticLayerTexture, staticTextureWidth, staticTextureHeight, staticLayerWidth, staticLayerHeight);
+}
+
+void RenderGame(const GameSnapshot& snapshot) {
+    int sceneWidth = std::max(1, static_cast<int>(viewWidth * renderScale));
+    int sceneHeight = std::max(1, static_cast<int>(viewHeight * renderScale));
+    bool scaled = sceneWidth < viewWidth;
+    if (!scaled) {
+        sceneWidth = viewWidth;
+        sceneHeight = viewHeight;
+    }
+    // Letterbox bars are cleared around the view; a scaled frame clears them after the copy.
+    glViewport(0, 0, windowWidth, windowHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    renderSubsystem = RENDER_FRAME;
+    if (!scaled) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        RecordDraw(0);
+    }
+    int sceneX = scaled ? 0 : viewX, sceneY = scaled ? 0 : viewY;
+    glViewport(sceneX, sceneY, sceneWidth, sceneHeight);
+    DrawStaticLayers(sceneX, sceneY, sceneWidth, sceneHeight);
+    RenderWorld(snapshot);
+    if (scaled) {
+        EnsureScreenTexture(sceneTexture, sceneTextureWidth, sceneTextureHeight, sceneWidth, sceneHeight, GL_LINEAR);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, sceneWidth, sceneHeight);
+        RecordDraw(0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glClear(GL_COLOR_BUFFER_BIT);
+        RecordDraw(0);
+        glViewport(viewX, viewY, viewWidth, viewHeight);
+        DrawScreenTexture(sceneTexture, sceneTextureWidth, sceneTextureHeight, sceneWidth, sceneHeight);
+    }
+    renderSubsystem = RENDER_HUD;
+    RenderUI(snapshot);
+    if (swarmMode) RenderSwarmOverlay(snapshot);
+    if (debugOverlay) RenderDebugOverlay(snapshot);
+    if (renderStatsOverlay) RenderStatsOverlay();
+    FinishRenderStats();
+}
+
+// Makes one step when the smoothed frame cost is over budget or has clear headroom, at most once
+// per RENDER_SCALE_COOLDOWN_MS. Cosmetic detail is given up before resolution, and resolution comes
+// back before detail.
+void UpdateRenderQuality(double renderMs) {
+    renderMsAverage = renderMsAverage == 0 ? renderMs : renderMsAverage * 0.9 + renderMs * 0.1;
+    if (!dynamicResolution && !adaptiveQuality) return;
+    int now = GetWallTime();
+    if (now - lastRenderScaleChange < RENDER_SCALE_COOLDOWN_MS) return;
+    if (renderMsAverage > frameBudgetMs) {
+        if (adaptiveQuality && qualityTier < QUALITY_TIER_COUNT - 1) ++qualityTier;
+        else if (dynamicResolution && renderScale > MIN_RENDER_SCALE) renderScale = std::max(MIN_RENDER_SCALE, renderScale - RENDER_SCALE_STEP);
+        else return;
+        lastRenderScaleChange = now;
+    }
+    else if (renderMsAverage < frameBudgetMs * 0.6) {
+        if (dynamicResolution && renderScale < 1.0f) renderScale = std::min(1.0f, renderScale + RENDER_SCALE_STEP);
+        else if (adaptiveQuality && qualityTier > bestQualityTier) --qualityTier;
+        else return;
+        lastRenderScaleChange = now;
+    }
+}
+
+// Keeps the 4:3 playfield, letterboxed, whatever the window shape.
+void Reshape(int width, int height) {
+    windowWidth = std::max(1, width);
+    windowHeight = std::max(1, height);
+    viewWidth = std::min(windowWidth, windowHeight * SCREEN_WIDTH / SCREEN_HEIGHT);
+    viewHeight = std::min(windowHeight, windowWidth * SCREEN_HEIGHT / SCREEN_WIDTH);
+    viewX = (windowWidth - viewWidth) / 2;
+    viewY = (windowHeight - viewHeight) / 2;
+}
+
+void CaptureSnapshot(GameSnapshot& snapshot, bool keepBursts, double simMs) {
+    snapshot.player = player;
+    std::copy(projectiles, projectiles + projectileCount, snapshot.projectiles);
+    snapshot.projectileCount = projectileCount;
+    snapshot.balls = balls;
+    CopyWorld(snapshot.world, world);
+    // Bursts in a snapshot the renderer never saw are carried over rather than dropped.
+    if (!keepBursts) snapshot.particleBursts.clear();
+    snapshot.particleBursts.insert(snapshot.particleBursts.end(), particleBursts.begin(), particleBursts.end());
+    particleBursts.clear();
+    snapshot.gameOver = gameOver;
+    snapshot.paused = paused;
+    snapshot.score = score;
+    snapshot.highScore = highScore;
+    snapshot.simTime = simTime;
+    snapshot.gameStartTime = gameStartTime;
+    snapshot.simMs = simMs;
+    snapshot.autopilotMs = autopilot ? autopilotAverageMs : -1.0;
+    // An unread snapshot keeps its older press so its latency is measured from the first arrival.
+    if (!keepBursts || snapshot.inputTime < 0) snapshot.inputTime = stepInputTime;
+    stepInputTime = -1.0;
+}
+
+// Triple buffering: the simulation owns snapshotBack, the renderer owns snapshotFront, and the
+// latest finished snapshot is parked in snapshotPending with SNAPSHOT_FRESH set until it is taken.
+void PublishSnapshot(double simMs) {
+    CaptureSnapshot(snapshots[snapshotBack], snapshotBackUnread, simMs);
+    int old = snapshotPending.exchange(snapshotBack | SNAPSHOT_FRESH, std::memory_order_acq_rel);
+    snapshotBack = old & 3;
+    snapshotBackUnread = (old & SNAPSHOT_FRESH) != 0;
+}
+
+const GameSnapshot& AcquireSnapshot(bool& fresh) {
+    fresh = (snapshotPending.load(std::memory_order_acquire) & SNAPSHOT_FRESH) != 0;
+    if (fresh) snapshotFront = snapshotPending.exchange(snapshotFront, std::memory_order_acq_rel) & 3;
+    return snapshots[snapshotFront];
+}
+
+// Single-producer (GLUT callbacks), single-consumer (simulation) ring of key events.
+bool PushInputEvent(const InputEvent& event) {
+    unsigned tail = inputQueueTail.load(std::memory_order_relaxed);
+    if (tail - inputQueueHead.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) return false;
+    inputQueue[tail % INPUT_QUEUE_SIZE] = event;
+    inputQueueTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool PopInputEvent(InputEvent& event) {
+    unsigned head = inputQueueHead.load(std::memory_order_relaxed);
+    if (head == inputQueueTail.load(std::memory_order_acquire)) return false;
+    event = inputQueue[head % INPUT_QUEUE_SIZE];
+    inputQueueHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void ApplyInputEvent(const InputEvent& event) {
+    if (event.special) {
+        if (event.key == GLUT_KEY_LEFT) { leftPressed = event.down; leftTapped |= event.down; }
+        else if (event.key == GLUT_KEY_RIGHT) { rightPressed = event.down; rightTapped |= event.down; }
+        return;
+    }
+    switch (event.key) {
+    case 'a': case 'A': leftPressed = event.down; leftTapped |= event.down; break;
+    case 'd': case 'D': rightPressed = event.down; rightTapped |= event.down; break;
+    case ' ': spacePressed = event.down; spaceTapped |= event.down; break;
+    case 'i': case 'I': if (event.down) invisibilityPressed = true; break;
+    case 'r': case 'R': if (event.down && gameOver) RestartGame(); break;
+    case 'p': case 'P': if (event.down && !gameOver) paused = !paused; break;
+    case '1': case '2': case '3': case '4': if (event.down) player.weapon = event.key - '1'; break;
+    }
+}
+
+void SimulationStep() {
+    double start = GetWallMillis();
     HandleInput();
-    if (!gameOver) UpdateGame();
-    RenderGame();
+    if (!gameOver && !paused) UpdateGame();
+    if (eventPhysics) SyncAllBalls();
+    PublishSnapshot(GetWallMillis() - start);
+}
+
+bool InputPending() {
+    return inputQueueHead.load(std::memory_order_acquire) != inputQueueTail.load(std::memory_order_acquire);
+}
+
+// Fixed 16 ms ticks, except that a key press runs the next tick as soon as it arrives; the early
+// tick takes that tick's slot, so the tick rate is unchanged and a tick is never more than one early.
+void SimulationThreadMain() {
+    auto next = std::chrono::steady_clock::now();
+    while (!simulationQuit.load(std::memory_order_relaxed)) {
+        SimulationStep();
+        next += std::chrono::milliseconds(SIM_TICK_MS);
+        auto now = std::chrono::steady_clock::now();
+        if (now - next > std::chrono::milliseconds(100)) next = now;
+        std::unique_lock<std::mutex> lock(inputWakeMutex);
+        if (gameOver || paused) {
+            // Nothing moves on the game-over or pause screen until a key arrives.
+            inputWake.wait_for(lock, std::chrono::milliseconds(IDLE_FRAME_MS),
+                [] { return simulationQuit.load(std::memory_order_relaxed) || InputPending(); });
+            next = std::chrono::steady_clock::now();
+            continue;
+        }
+        inputWake.wait_until(lock, next, [&] {
+            return simulationQuit.load(std::memory_order_relaxed)
+                || (InputPending() && std::chrono::steady_clock::now() >= next - std::chrono::milliseconds(SIM_TICK_MS));
+        });
+    }
+}
+
+void StopSimulationThread() {
+    if (!simulationThread.joinable()) return;
+    simulationQuit.store(true);
+    inputWake.notify_one();
+    simulationThread.join();
+}
+
+void Display() {
+    if (!threadedSim) {
+        if (timerFrame) {
+            if (!earlyStepTaken) SimulationStep();
+            earlyStepTaken = false;
+        }
+        else if (!earlyStepTaken && InputPending()) {
+            SimulationStep();
+            earlyStepTaken = true;
+        }
+        timerFrame = false;
+    }
+    bool fresh;
+    const GameSnapshot& snapshot = AcquireSnapshot(fresh);
+    if (fresh) {
+        for (const auto& burst : snapshot.particleBursts) SpawnParticleBurst(burst);
+    }
+    double renderStart = GetWallMillis();
+    int now = GetWallTime();
+    if (!snapshot.paused) UpdateParticles(std::min((now - lastParticleUpdateTime) / static_cast<float>(SIM_TICK_MS), 4.0f));
+    lastParticleUpdateTime = now;
+    BeginGpuTimer();
+    RenderGame(snapshot);
+    EndGpuTimer();
+    // Finishing here makes the measured time include rasterization, which is what the quality
+    // governor needs to see on software renderers. With GPU timing the frame costs whichever side
+    // is slower, using the GPU time of a frame or two ago.
+    if (finishFrames && (dynamicResolution || adaptiveQuality)) glFinish();
+    UpdateRenderQuality(std::max(GetWallMillis() - renderStart, gpuTiming ? gpuFrameMs : 0.0));
+    if (swarmMode) {
+        RecordSwarmFrame(snapshot.simMs, GetWallMillis() - renderStart, (snapshot.simTime - snapshot.gameStartTime) / 1000.0,
+            snapshot.balls.size(), EntityCount<MeteorState>(snapshot.world), EntityCount<EffectShape>(snapshot.world));
+    }
     glutSwapBuffers();
+    if (inputLatency && fresh && snapshot.inputTime >= 0) {
+        // Wait for the swap so the sample ends when the frame is actually presented.
+        glFinish();
+        lastInputLatencyMs = GetWallMillis() - snapshot.inputTime;
+        inputLatencySamples.push_back(lastInputLatencyMs);
+    }
 }
 
-void Timer(int) {
-    glutPostRedisplay();
-    glutTimerFunc(16, Timer, 0);
+void WriteInputLatencySummary() {
+    if (!inputLatency || inputLatencySamples.empty()) return;
+    double stats[4];
+    Percentiles(inputLatencySamples, stats);
+    printf("input-to-present latency over %zu presses: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+        inputLatencySamples.size(), stats[0], stats[1], stats[2], stats[3]);
 }
 
-void RestartGame() {
-    balls.clear();
-    bubbleEffects.clear();
-    meteors.clear();
-    player = { {SCREEN_WIDTH / 2, SCREEN_HEIGHT - 50}, false, 80, 130, 0, false, 0, MAX_INVISIBILITY_USES, 1.0f };
-    laser = { {0, 0}, 0, false };
+// Redraws at full rate while the game is live. On the game-over and pause screens only slow pulse
+// animations change, so it drops to IDLE_FRAME_MS; a hidden window is not drawn at all, and without
+// --threaded the timer then steps the simulation itself.
+void Timer(int generation) {
+    if (generation != timerGeneration) return;
+    const GameSnapshot& shown = snapshots[snapshotFront];
+    bool idle = threadedSim ? shown.gameOver || shown.paused : gameOver || paused;
+    if (windowVisible) {
+        timerFrame = true;
+        glutPostRedisplay();
+    }
+    else if (!threadedSim && !idle) {
+        SimulationStep();
+    }
+    timerIdle = idle || (!windowVisible && threadedSim);
+    glutTimerFunc(timerIdle ? IDLE_FRAME_MS : 16, Timer, generation);
+}
+
+void RestartFrameTimer() {
+    if (!timerIdle) return;
+    timerIdle = false;
+    glutTimerFunc(16, Timer, ++timerGeneration);
+}
+
+void Visibility(int state) {
+    windowVisible = state == GLUT_VISIBLE;
+    if (windowVisible) {
+        RestartFrameTimer();
+        glutPostRedisplay();
+    }
+}
+
+// Starts a new game from gameSeed.
+void ResetGame() {
+    ClearBalls();
+    ClearEntities(world);
+    // The meteor drop clock keeps running across games.
+    CancelTimer(scoreTimer);
+    CancelTimer(invisibilityTimer);
+    player = { {SCREEN_WIDTH / 2, SCREEN_HEIGHT - 50}, false, 80, 130, 0, false, 0, GAME_MODES[gameMode].invisibilityUses, 1.0f, WEAPON_LASER };
+    projectileCount = 0;
     score = 0;
     gameOver = false;
     gameStartTime = GetTime();
-    lastScoreIncrementTime = gameStartTime;
     lastInvisibilityRewardScore = 0;
     lastBallSpawnScore = 0;
+    scoreTimer = ScheduleTimer(SimTick() + SCORE_INTERVAL_TICKS, TIMER_SCORE);
+    SeedGameRandom();
+    stateHash = STATE_HASH_SEED;
     SpawnBall(SCREEN_WIDTH / 2, 100, 30);
 }
 
-void KeyDown(unsigned char key, int, int) {
-    switch (key) {
-    case 'a': case 'A': leftPressed = true; break;
-    case 'd': case 'D': rightPressed = true; break;
-    case ' ': spacePressed = true; break;
-    case 'i': case 'I': invisibilityPressed = true; break;
-    case 'r': case 'R': if (gameOver) RestartGame(); break;
+void RestartGame() {
+    gameSeed = seedOverride ? gameSeed + 1 : static_cast<unsigned>(time(nullptr)) ^ static_cast<unsigned>(rand());
+    ResetGame();
+}
+
+void InputRedisplay(int) {
+    glutPostRedisplay();
+}
+
+// Key presses are stepped and drawn right away instead of waiting for the next frame timer. With
+// --threaded the simulation thread is woken and the redraw follows a millisecond later, once the
+// early tick has had time to publish.
+void WakeForInput() {
+    RestartFrameTimer();
+    if (threadedSim) {
+        inputWake.notify_one();
+        glutTimerFunc(1, InputRedisplay, 0);
+    }
+    else {
+        glutPostRedisplay();
     }
 }
 
+void KeyDown(unsigned char key, int, int) {
+    PushInputEvent({ key, false, true, GetWallMillis() });
+    WakeForInput();
+}
+
 void KeyUp(unsigned char key, int, int) {
-    switch (key) {
-    case 'a': case 'A': leftPressed = false; break;
-    case 'd': case 'D': rightPressed = false; break;
-    case ' ': spacePressed = false; break;
-    }
+    PushInputEvent({ key, false, false, GetWallMillis() });
 }
 
 void SpecialDown(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) leftPressed = true;
-    else if (key == GLUT_KEY_RIGHT) rightPressed = true;
+    // The overlay is presentation only, so it never reaches the simulation or a recording.
+    if (key == GLUT_KEY_F3) {
+        debugOverlay = !debugOverlay;
+        return;
+    }
+    if (key == GLUT_KEY_F4) {
+        renderStatsOverlay = !renderStatsOverlay;
+        return;
+    }
+    PushInputEvent({ key, true, true, GetWallMillis() });
+    WakeForInput();
 }
 
 void SpecialUp(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) leftPressed = false;
-    else if (key == GLUT_KEY_RIGHT) rightPressed = false;
+    if (key == GLUT_KEY_F3 || key == GLUT_KEY_F4) return;
+    PushInputEvent({ key, true, false, GetWallMillis() });
 }
 
 GLuint LoadTexture(const char* filename) {
@@ -689,7 +4203,7 @@ GLuint LoadTexture(const char* filename) {
     }
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    BindTexture(texture);
     GLenum format = channels == 3 ? GL_RGB : GL_RGBA;
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
     gluBuild2DMipmaps(GL_TEXTURE_2D, format, width, height, format, GL_UNSIGNED_BYTE, data);
@@ -702,18 +4216,25 @@ GLuint LoadTexture(const char* filename) {
 }
 
 void InitializeGame() {
-    player = { {SCREEN_WIDTH / 2, SCREEN_HEIGHT - 50}, false, 80, 130, 0, false, 0, MAX_INVISIBILITY_USES, 1.0f };
+    player = { {SCREEN_WIDTH / 2, SCREEN_HEIGHT - 50}, false, 80, 130, 0, false, 0, GAME_MODES[gameMode].invisibilityUses, 1.0f, WEAPON_LASER };
     gameOver = false;
     score = 0;
     gameStartTime = GetTime();
-    lastScoreIncrementTime = gameStartTime;
     lastInvisibilityRewardScore = 0;
     lastBallSpawnScore = 0;
-    srand(static_cast<unsigned>(time(nullptr)));
-    backgroundTexture = LoadTexture("background.jpg");
-    ufoTexture = LoadTexture("ufo.png");
-    meteorTexture = LoadTexture("meteor.png");
+    ResetTimers(SimTick());
+    scoreTimer = ScheduleTimer(SimTick() + SCORE_INTERVAL_TICKS, TIMER_SCORE);
+    if (!seedOverride) gameSeed = static_cast<unsigned>(time(nullptr));
+    SeedGameRandom();
+    stateHash = STATE_HASH_SEED;
+    if (!headless) {
+        InitParticles();
+        backgroundTexture = LoadTexture("background.jpg");
+        ufoTexture = LoadTexture("ufo.png");
+        meteorTexture = LoadTexture("meteor.png");
+    }
     LoadHighScore();
+    ReservePools();
     SpawnBall(SCREEN_WIDTH / 2, 100, 30);
 }
 
@@ -722,25 +4243,478 @@ void InitOpenGL() {
     glLoadIdentity();
     gluOrtho2D(0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
     glMatrixMode(GL_MODELVIEW);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_LINE_SMOOTH);
+    EnableState(GL_BLEND);
+    SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    EnableState(GL_LINE_SMOOTH);
     glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    if (renderer && (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe") || strstr(renderer, "swrast")
+        || strstr(renderer, "Software") || strstr(renderer, "GDI Generic"))) {
+        finishFrames = true;
+    }
+    InitShaders();
+    InitGpuTimer();
+}
+
+// Unrecognised arguments are left for glutInit.
+void ParseArguments(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--step") == 0 && i + 1 < argc) {
+            simStepTicks = std::max(1, std::min(MAX_SIM_STEP_TICKS, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--trail-length") == 0 && i + 1 < argc) {
+            trailLength = std::max(0, std::min(MAX_TRAIL_LENGTH, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm") == 0) {
+            swarmMode = true;
+        }
+        else if (strcmp(argv[i], "--swarm-balls") == 0 && i + 1 < argc) {
+            swarmBalls = std::max(0, std::min(MAX_SWARM_COUNT, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm-meteors") == 0 && i + 1 < argc) {
+            swarmMeteors = std::max(0, std::min(MAX_SWARM_COUNT, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm-projectiles") == 0 && i + 1 < argc) {
+            swarmProjectiles = std::max(0, std::min(MAX_PROJECTILES, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm-effects") == 0 && i + 1 < argc) {
+            swarmEffects = std::max(0, std::min(MAX_SWARM_COUNT, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm-ramp") == 0 && i + 1 < argc) {
+            swarmRampSeconds = std::max(1.0f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--swarm-summary") == 0 && i + 1 < argc) {
+            swarmSummaryFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--alloc-check") == 0) {
+            allocCheck = headless = true;
+        }
+        else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            renderScale = std::max(MIN_RENDER_SCALE, std::min(1.0f, static_cast<float>(atof(argv[++i]))));
+        }
+        else if (strcmp(argv[i], "--no-shaders") == 0) {
+            useShaders = false;
+        }
+        else if (strcmp(argv[i], "--fixed-scale") == 0) {
+            dynamicResolution = false;
+        }
+        else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            for (int tier = 0; tier < QUALITY_TIER_COUNT; ++tier) {
+                if (strcmp(name, QUALITY_TIERS[tier].name) == 0) bestQualityTier = qualityTier = tier;
+            }
+        }
+        else if (strcmp(argv[i], "--finish-frames") == 0) {
+            finishFrames = true;
+        }
+        else if (strcmp(argv[i], "--fixed-quality") == 0) {
+            adaptiveQuality = false;
+        }
+        else if (strcmp(argv[i], "--debug-overlay") == 0) {
+            debugOverlay = true;
+        }
+        else if (strcmp(argv[i], "--render-stats") == 0) {
+            renderStatsOverlay = true;
+        }
+        else if (strcmp(argv[i], "--render-stats-out") == 0 && i + 1 < argc) {
+            renderStatsFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            frameBudgetMs = std::max(1.0f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetryFile = argv[++i];
+            telemetryRequested = true;
+        }
+        else if (strcmp(argv[i], "--no-telemetry") == 0) {
+            telemetryEnabled = false;
+        }
+        else if (strcmp(argv[i], "--audio") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "null") == 0) audioBackend = AUDIO_NULL;
+            else if (strcmp(name, "wav") == 0) audioBackend = AUDIO_WAV;
+            else if (strcmp(name, "alsa") == 0) audioBackend = AUDIO_ALSA;
+            else std::cerr << "Unknown audio output: " << name << std::endl;
+            audioRequested = true;
+        }
+        else if (strcmp(argv[i], "--audio-file") == 0 && i + 1 < argc) {
+            audioFile = argv[++i];
+            audioBackend = AUDIO_WAV;
+            audioRequested = true;
+        }
+        else if (strcmp(argv[i], "--no-audio") == 0) {
+            audioBackend = AUDIO_OFF;
+            audioRequested = true;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobThreads = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            benchSessions.push_back(argv[++i]);
+            benchmark = true;
+        }
+        else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            benchOutFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench-baseline") == 0 && i + 1 < argc) {
+            benchBaselineFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench-threshold") == 0 && i + 1 < argc) {
+            benchThreshold = std::max(0.0f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--bench-render") == 0) {
+            benchRender = true;
+        }
+        else if (strcmp(argv[i], "--input-latency") == 0) {
+            inputLatency = true;
+        }
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int mode = 0;
+            while (mode < GAME_MODE_COUNT && strcmp(GAME_MODES[mode].name, name) != 0) ++mode;
+            if (mode < GAME_MODE_COUNT) gameMode = mode;
+            else std::cerr << "Unknown game mode: " << name << std::endl;
+        }
+        else if (strcmp(argv[i], "--autopilot") == 0) {
+            autopilot = true;
+        }
+        else if (strcmp(argv[i], "--threaded") == 0) {
+            threadedSim = true;
+        }
+        else if (strcmp(argv[i], "--event-physics") == 0) {
+            eventPhysics = true;
+        }
+        else if (strcmp(argv[i], "--fixed-point") == 0) {
+            fixedPoint = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            headlessTicks = std::max(1LL, atoll(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            gameSeed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+            seedOverride = true;
+        }
+    }
+}
+
+// Runs the simulation without a window for --ticks ticks, restarting after each death.
+int RunHeadless() {
+    InitializeGame();
+    StartReplayRecording();
+    int runs = 1, wallStart = GetWallTime();
+    long long ticks = 0, allocatingTicks = 0, allocations = 0;
+    while (ticks < headlessTicks) {
+        HandleInput();
+        if (gameOver) {
+            RestartGame();
+            ++runs;
+        }
+        double simStart = GetWallMillis();
+#ifdef UFO_ALLOC_CHECK
+        long long before = heapAllocations.load();
+        UpdateGame();
+        long long allocated = heapAllocations.load() - before;
+        if (ticks >= ALLOC_CHECK_WARMUP_TICKS && allocated > 0) {
+            ++allocatingTicks;
+            allocations += allocated;
+        }
+#else
+        UpdateGame();
+#endif
+        // A recorded game syncs cold balls every step, as the windowed game and replays do, so the
+        // state hashes match bit for bit.
+        if (eventPhysics && replayRecording) SyncAllBalls();
+        if (swarmMode) RecordSwarmFrame(GetWallMillis() - simStart, 0.0, (GetTime() - gameStartTime) / 1000.0, balls.size(), EntityCount<MeteorState>(world), EntityCount<EffectShape>(world));
+        ticks += simStepTicks;
+    }
+    int wallMs = GetWallTime() - wallStart;
+    WriteSwarmSummary();
+    printf("ticks %lld, sim %.1f s, wall %.3f s, runs %d, balls %zu, ball events %lld, score %d, state %08x\n",
+        ticks, ticks * SIM_TICK_MS / 1000.0, wallMs / 1000.0, runs, balls.size(), ballEventsProcessed, score, stateHash);
+    if (autopilot) {
+        printf("autopilot: %lld plans, avg %.4f ms, max %.4f ms per tick\n", autopilotPlanCount,
+            autopilotTotalMs / std::max(1LL, autopilotPlanCount), autopilotMaxMs);
+    }
+    if (allocCheck) {
+        printf("alloc check: %lld allocations in %lld of %lld steady-state ticks\n", allocations, allocatingTicks,
+            std::max(0LL, ticks - ALLOC_CHECK_WARMUP_TICKS));
+        return allocations > 0 ? 1 : 0;
+    }
+    return 0;
+}
+
+// Process-wide peak resident memory in KB.
+long PeakMemoryKb() {
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return -1;
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+#endif
+}
+
+bool LoadReplay(const char* path, ReplayHeader& header, std::vector<ReplayRecord>& records) {
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, path, "rb") != 0) file = nullptr;
+#else
+    FILE* file = fopen(path, "rb");
+#endif
+    if (!file) return false;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == REPLAY_MAGIC && (header.version == 1 || header.version == REPLAY_VERSION);
+    // Version 1 records stop before the hash.
+    size_t recordSize = header.version == 1 ? offsetof(ReplayRecord, hash) : sizeof(ReplayRecord);
+    ReplayRecord record = {};
+    while (valid && fread(&record, recordSize, 1, file) == 1) records.push_back(record);
+    fclose(file);
+    // A recording cut short by a crash still replays up to its last change.
+    if (valid && (records.empty() || records.back().keys != REPLAY_END)) {
+        records.push_back({ records.empty() ? 0 : records.back().step + 1, REPLAY_END, -1, 0 });
+    }
+    return valid;
+}
+
+// Replays one recorded session as fast as possible, timing every tick (input plus UpdateGame) and,
+// with --bench-render, every frame drawn into the hidden window.
+BenchResult ReplaySession(const char* path, const ReplayHeader& header, const std::vector<ReplayRecord>& records) {
+    BenchResult result = { path, 0, 0, {}, {}, 0, -1, false, -1 };
+    int steps = records.back().step;
+    std::vector<double> tickMs, frameMs;
+    tickMs.reserve(steps);
+    if (benchRender) frameMs.reserve(steps);
+    simTime = 0;
+    lastMeteorDropTime = 0;
+    ResetTimers(0);
+    gameSeed = header.seed;
+    simStepTicks = std::max(1, std::min(MAX_SIM_STEP_TICKS, header.stepTicks));
+    eventPhysics = (header.flags & REPLAY_EVENT_PHYSICS) != 0;
+    fixedPoint = (header.flags & REPLAY_FIXED_POINT) != 0;
+    gameMode = std::min(GAME_MODE_COUNT - 1, header.flags >> REPLAY_MODE_SHIFT);
+    ResetGame();
+    size_t next = 0;
+#ifdef UFO_ALLOC_CHECK
+    long long allocationsBefore = heapAllocations.load();
+#endif
+    for (int step = 0;; ++step) {
+        for (; next < records.size() && records[next].step == step; ++next) {
+            const ReplayRecord& record = records[next];
+            bool diverged = record.score >= 0 && (record.score != score || (header.version >= 2 && record.hash != stateHash));
+            if (diverged && !result.desync) {
+                result.desync = true;
+                result.desyncStep = step;
+            }
+            if (record.keys != REPLAY_END) ApplyReplayKeys(record.keys);
+        }
+        if (step >= steps || gameOver) break;
+        double start = GetWallMillis();
+        HandleInput();
+        UpdateGame();
+        if (eventPhysics) SyncAllBalls();
+        tickMs.push_back(GetWallMillis() - start);
+        if (benchRender) {
+            double renderStart = GetWallMillis();
+            PublishSnapshot(tickMs.back());
+            bool fresh;
+            const GameSnapshot& snapshot = AcquireSnapshot(fresh);
+            if (fresh) {
+                for (const auto& burst : snapshot.particleBursts) SpawnParticleBurst(burst);
+            }
+            UpdateParticles(static_cast<float>(simStepTicks));
+            RenderGame(snapshot);
+            glFinish();
+            frameMs.push_back(GetWallMillis() - renderStart);
+        }
+    }
+#ifdef UFO_ALLOC_CHECK
+    result.allocations = heapAllocations.load() - allocationsBefore;
+#endif
+    result.ticks = static_cast<int>(tickMs.size()) * simStepTicks;
+    result.score = score;
+    Percentiles(tickMs, result.tick);
+    Percentiles(frameMs, result.frame);
+    result.peakKb = PeakMemoryKb();
+    return result;
+}
+
+const char* const BENCH_COLUMNS[] = { "tick_p50_ms", "tick_p95_ms", "tick_p99_ms", "tick_max_ms", "frame_p50_ms", "frame_p95_ms", "frame_p99_ms", "frame_max_ms" };
+
+// Flags every p50/p95/p99 time (maxima are too noisy to gate on) and allocation count that grew by
+// more than --bench-threshold percent over the baseline row for the same session.
+int CompareBenchBaseline(const std::vector<BenchResult>& results) {
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, benchBaselineFile, "r") != 0) file = nullptr;
+#else
+    FILE* file = fopen(benchBaselineFile, "r");
+#endif
+    if (!file) {
+        std::cerr << "Failed to read benchmark baseline: " << benchBaselineFile << std::endl;
+        return 1;
+    }
+    int regressions = 0;
+    char line[1024];
+    double limit = 1.0 + benchThreshold / 100.0;
+    while (fgets(line, sizeof(line), file)) {
+        char* comma = strchr(line, ',');
+        if (!comma || line[0] == '#') continue;
+        *comma = '\0';
+        double base[8];
+        long peakKb;
+        long long allocations;
+        int ticks, score;
+        if (sscanf(comma + 1, "%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%ld,%lld", &ticks, &score, &base[0], &base[1], &base[2], &base[3],
+            &base[4], &base[5], &base[6], &base[7], &peakKb, &allocations) != 12) continue;
+        for (const auto& result : results) {
+            if (strcmp(result.session, line) != 0) continue;
+            for (int i = 0; i < 8; ++i) {
+                double current = i < 4 ? result.tick[i] : result.frame[i - 4];
+                // A microsecond of slack keeps near-zero timings from tripping the ratio.
+                if (i % 4 == 3 || base[i] < 0 || current < 0 || current <= base[i] * limit + 0.001) continue;
+                printf("REGRESSION %s %s: %.4f ms -> %.4f ms (+%.1f%%)\n", line, BENCH_COLUMNS[i], base[i], current, (current / base[i] - 1.0) * 100.0);
+                ++regressions;
+            }
+            if (allocations >= 0 && result.allocations > allocations * limit) {
+                printf("REGRESSION %s allocations: %lld -> %lld\n", line, allocations, result.allocations);
+                ++regressions;
+            }
+        }
+    }
+    fclose(file);
+    printf("baseline %s: %d regression(s) at %.1f%% threshold\n", benchBaselineFile, regressions, benchThreshold);
+    return regressions > 0 ? 1 : 0;
+}
+
+// Replays every --bench session and writes one CSV row of timings per session to --bench-out.
+int RunBenchmark(int& argc, char** argv) {
+    if (benchRender) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+        glutInitWindowSize(SCREEN_WIDTH, SCREEN_HEIGHT);
+        glutCreateWindow("UFO STRIKE benchmark");
+        glutHideWindow();
+        InitOpenGL();
+        Reshape(SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    else {
+        headless = true;
+    }
+    // Recorded keys drive the player.
+    autopilot = false;
+    seedOverride = true;
+    InitializeGame();
+    std::vector<BenchResult> results;
+    int failures = 0;
+    for (const char* path : benchSessions) {
+        ReplayHeader header;
+        std::vector<ReplayRecord> records;
+        if (!LoadReplay(path, header, records)) {
+            std::cerr << "Failed to load recording: " << path << std::endl;
+            ++failures;
+            continue;
+        }
+        results.push_back(ReplaySession(path, header, records));
+        const BenchResult& result = results.back();
+        printf("%s: %d ticks, score %d, tick p50 %.4f p95 %.4f p99 %.4f max %.4f ms", path, result.ticks, result.score,
+            result.tick[0], result.tick[1], result.tick[2], result.tick[3]);
+        if (benchRender) printf(", frame p50 %.3f p95 %.3f p99 %.3f max %.3f ms", result.frame[0], result.frame[1], result.frame[2], result.frame[3]);
+        printf(", peak %ld KB, allocations %lld", result.peakKb, result.allocations);
+        if (result.desync) printf(", DESYNC by step %d", result.desyncStep);
+        printf("\n");
+        if (result.desync) ++failures;
+    }
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    if (fopen_s(&file, benchOutFile, "w") != 0) file = nullptr;
+#else
+    FILE* file = fopen(benchOutFile, "w");
+#endif
+    if (!file) {
+        std::cerr << "Failed to write benchmark results: " << benchOutFile << std::endl;
+        return 1;
+    }
+    fprintf(file, "# allocations are -1 unless built with -DUFO_ALLOC_CHECK; peak_rss_kb is the process high-water mark\n");
+    fprintf(file, "session,ticks,score");
+    for (const char* column : BENCH_COLUMNS) fprintf(file, ",%s", column);
+    fprintf(file, ",peak_rss_kb,allocations,desync\n");
+    for (const auto& result : results) {
+        fprintf(file, "%s,%d,%d", result.session, result.ticks, result.score);
+        for (int i = 0; i < 8; ++i) fprintf(file, ",%.4f", i < 4 ? result.tick[i] : result.frame[i - 4]);
+        fprintf(file, ",%ld,%lld,%d\n", result.peakKb, result.allocations, result.desync ? 1 : 0);
+    }
+    fclose(file);
+    if (benchBaselineFile && CompareBenchBaseline(results) != 0) ++failures;
+    return failures > 0 ? 1 : 0;
 }
 
 int main(int argc, char** argv) {
+    ParseArguments(argc, argv);
+#ifndef UFO_ALLOC_CHECK
+    if (allocCheck) {
+        fprintf(stderr, "--alloc-check needs a build with -DUFO_ALLOC_CHECK\n");
+        return 1;
+    }
+#endif
+#ifndef UFO_ALSA
+    if (audioBackend == AUDIO_ALSA) {
+        fprintf(stderr, "--audio alsa needs a build with -DUFO_ALSA (and -lasound)\n");
+        return 1;
+    }
+#endif
+    if (!GAME_MODES[gameMode].meteors) swarmMeteors = 0;
+    if (fixedPoint && eventPhysics) {
+        std::cerr << "--fixed-point has its own ball physics; ignoring --event-physics" << std::endl;
+        eventPhysics = false;
+    }
+    StartJobSystem();
+    atexit(StopJobSystem);
+    // Headless runs and benchmarks only log when asked to.
+    if ((headless || benchmark) && !telemetryRequested) telemetryEnabled = false;
+    StartTelemetryWriter();
+    atexit(StopTelemetryWriter);
+    // Benchmarks are silent; headless runs play only when an output is given.
+    if (benchmark || (headless && !audioRequested)) audioBackend = AUDIO_OFF;
+    StartAudio();
+    atexit(StopAudio);
+    atexit(StopReplayRecording);
+    if (benchmark) return RunBenchmark(argc, argv);
+    if (headless) return RunHeadless();
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
     glutInitWindowSize(SCREEN_WIDTH, SCREEN_HEIGHT);
     glutCreateWindow("UFO STRIKE");
     InitOpenGL();
     InitializeGame();
+    StartReplayRecording();
+    StartLeaderboardWriter();
+    atexit(StopLeaderboardWriter);
+    StartRenderStats();
+    atexit(StopRenderStats);
+    atexit(WriteSwarmSummary);
+    atexit(WriteInputLatencySummary);
+    if (inputLatency) inputLatencySamples.reserve(4096);
+    if (threadedSim) {
+        simulationThread = std::thread(SimulationThreadMain);
+        atexit(StopSimulationThread);
+    }
     glutDisplayFunc(Display);
+    glutReshapeFunc(Reshape);
     glutTimerFunc(16, Timer, 0);
+    // Held keys must not auto-repeat into release/press pairs.
+    glutIgnoreKeyRepeat(1);
     glutKeyboardFunc(KeyDown);
     glutKeyboardUpFunc(KeyUp);
     glutSpecialFunc(SpecialDown);
     glutSpecialUpFunc(SpecialUp);
+    glutVisibilityFunc(Visibility);
     glutMainLoop();
     return 0;
 }
\ No newline at end of file